@@ -5,31 +5,118 @@
  *      Author: Hasti
  */
 #include <assert.h>
+#include <stdbool.h>
 #include <string.h>
+#include <sys/param.h>
 
 #include "sysinit/sysinit.h"
 #include "host/ble_hs.h"
+#include "nimble/nimble_port.h"
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
 #include "driver/temperature_sensor.h"
 #include "os/endian.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
 
 #include "temp.h"
 #include "led.h"
 #include "gatt_svr.h"
+#include "telemetry.h"
+#include "trace.h"
 
 #define TAG "Nimble_ble_PRPH-gatt-svr"
 
 /* A characteristic that can be subscribed to */
 uint16_t temp_handle;
 uint16_t led_handle;
+static uint16_t trace_handle;
+static uint16_t light_handle;
+static uint16_t ind_stats_handle;
 static uint8_t gatt_svr_chr_val;
-static uint8_t notify_enabled = 0; // Notification status
 
-extern uint8_t led_status;
+/* Subscriptions, keyed by connection and characteristic value handle. A
+ * slot with no flags is free. NimBLE serves the CCCDs itself, so only
+ * BLE_GAP_EVENT_SUBSCRIBE fills the table, through gatt_svr_subscribe().
+ *
+ * ATT allows one indication in flight per connection, whichever
+ * characteristic it is for, and NimBLE keeps only one pending handle per
+ * connection. Values indicated meanwhile collapse into one pending value
+ * per subscription, the latest; when the confirmation (or its failure)
+ * comes back in BLE_GAP_EVENT_NOTIFY_TX, the connection's next pending
+ * value goes out.
+ */
+#define GATT_SVR_SUBS (CONFIG_BT_NIMBLE_MAX_CONNECTIONS * 2)
+#define GATT_SVR_VALUE_MAX 8
+
+struct gatt_svr_sub {
+	uint16_t conn_handle;
+	uint16_t attr_handle;
+	uint8_t flags;
+	uint16_t pending_len;
+	uint8_t pending[GATT_SVR_VALUE_MAX];
+	struct gatt_svr_ind_stats stats;
+};
+
+static struct gatt_svr_sub subs[GATT_SVR_SUBS];
+
+/* Indications in flight, one per connection at most. A slot with no
+ * attribute handle is free.
+ */
+struct gatt_svr_ind {
+	uint16_t conn_handle;
+	uint16_t attr_handle;
+	int64_t sent_us;
+};
+
+static struct gatt_svr_ind inds[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+
+/* Values go out in mbufs from this reserved pool, sized once at init, so
+ * notifying at a high rate neither touches the heap nor competes with the
+ * host for msys. Each block holds the packet header, the host's user
+ * header and one value.
+ */
+#define GATT_SVR_MBUF_SIZE OS_ALIGN(sizeof(struct os_mbuf) + sizeof(struct os_mbuf_pkthdr) + \
+                                    sizeof(struct ble_mbuf_hdr) + GATT_SVR_VALUE_MAX, OS_ALIGNMENT)
+
+static os_membuf_t notify_mbuf_mem[OS_MEMPOOL_SIZE(CONFIG_GATT_NOTIFY_MBUFS, GATT_SVR_MBUF_SIZE)];
+static struct os_mempool notify_mempool;
+static struct os_mbuf_pool notify_mbuf_pool;
+static struct gatt_svr_mbuf_stats mbuf_stats;
+
+/* Trace reads serve a snapshot of the newest records that fit in one
+ * attribute value. NimBLE builds the whole value for the Read and for
+ * every Read Blob and slices it at the offset itself, so the snapshot is
+ * taken when a long read starts and kept until the chunk served comes
+ * back short of the MTU, i.e. the peer has it all. A read left unfinished
+ * for longer than GATT_SVR_TRACE_READ_US, or one from another connection,
+ * starts over.
+ */
+#define GATT_SVR_TRACE_RECS (BLE_ATT_ATTR_MAX_LEN / sizeof(struct trace_rec))
+#define GATT_SVR_TRACE_READ_US 1000000
+
+static struct {
+	struct trace_rec recs[GATT_SVR_TRACE_RECS];
+	uint16_t len;            /* bytes */
+	uint16_t served;         /* bytes handed out in this long read */
+	uint16_t conn_handle;
+	bool active;
+	int64_t last_us;
+} trace_snap;
+
+/* LED state changes, reported from the host task. */
+static struct ble_npl_event led_changed_ev;
 
 static int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                                struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int gatt_svr_es_dsc_access(uint16_t conn_handle, uint16_t attr_handle,
+                                  struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int gatt_svr_trace_access(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int gatt_svr_light_access(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int gatt_svr_ind_stats_access(uint16_t conn_handle, uint16_t attr_handle,
+                                     struct ble_gatt_access_ctxt *ctxt, void *arg);
 
 static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
 	{
@@ -41,8 +128,31 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
 				/* Characteristic: Heart-rate measurement */
 				.uuid = BLE_UUID16_DECLARE(BLE_TEMP_CHAR_UUID),
 				.access_cb = gatt_svr_chr_access,
-				.flags = BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_READ,
+				.flags = BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE | BLE_GATT_CHR_F_READ,
 				.val_handle = &temp_handle,
+				.descriptors = (struct ble_gatt_dsc_def[])
+				{ {
+						.uuid = BLE_UUID16_DECLARE(BLE_ES_MEASUREMENT_DESC_UUID),
+						.att_flags = BLE_ATT_F_READ,
+						.access_cb = gatt_svr_es_dsc_access,
+					}, {
+						.uuid = BLE_UUID16_DECLARE(BLE_ES_CONFIG_DESC_UUID),
+						.att_flags = BLE_ATT_F_READ | BLE_ATT_F_WRITE,
+						.access_cb = gatt_svr_es_dsc_access,
+					}, {
+						.uuid = BLE_UUID16_DECLARE(BLE_ES_TRIGGER_DESC_UUID),
+						.att_flags = BLE_ATT_F_READ | BLE_ATT_F_WRITE,
+						.access_cb = gatt_svr_es_dsc_access,
+						.arg = (void *)0,
+					}, {
+						.uuid = BLE_UUID16_DECLARE(BLE_ES_TRIGGER_DESC_UUID),
+						.att_flags = BLE_ATT_F_READ | BLE_ATT_F_WRITE,
+						.access_cb = gatt_svr_es_dsc_access,
+						.arg = (void *)1,
+					}, {
+						0, /* No more descriptors in this characteristic */
+					},
+				},
 			}, {
 					0, /* No more characteristics in this service */
 			},
@@ -60,6 +170,24 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
 				.access_cb = gatt_svr_chr_access,
 				.flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE,
 				.val_handle = &led_handle,
+			}, {
+				/* Lighting control: colour, brightness, transition and effect */
+				.uuid = BLE_UUID16_DECLARE(CUSTOM_LIGHT_CHAR_UUID),
+				.access_cb = gatt_svr_light_access,
+				.flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+				.val_handle = &light_handle,
+			}, {
+				/* Trace ring: read the records, write 0x01 to log them, 0x00 to clear */
+				.uuid = BLE_UUID16_DECLARE(CUSTOM_TRACE_CHAR_UUID),
+				.access_cb = gatt_svr_trace_access,
+				.flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+				.val_handle = &trace_handle,
+			}, {
+				/* Indication statistics of the reading peer's temperature indications */
+				.uuid = BLE_UUID16_DECLARE(CUSTOM_IND_STATS_CHAR_UUID),
+				.access_cb = gatt_svr_ind_stats_access,
+				.flags = BLE_GATT_CHR_F_READ,
+				.val_handle = &ind_stats_handle,
 			}, {
 					0, /* No more descriptors in this characteristic */
 			},
@@ -89,13 +217,13 @@ static int gatt_svr_write(struct os_mbuf *om, uint16_t min_len, uint16_t max_len
     return 0;
 }
 
-static int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
-                               struct ble_gatt_access_ctxt *ctxt, void *arg)
+static int gatt_svr_chr_handle(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt)
 {
 	int rc;
 //	char temp_str[2];
 
-	ESP_LOGI(TAG, "GATT access event; conn_handle=%d attr_handle=%d "
+	HOT_LOGI(TAG, "GATT access event; conn_handle=%d attr_handle=%d "
 				  "op=%d",
 			 conn_handle, attr_handle, ctxt->op);
 
@@ -104,12 +232,13 @@ static int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
 		// Read characteristic value
 		if(attr_handle == temp_handle)
 		{
-			float temp_value = read_temperature();
-			uint8_t temp = (uint8_t)temp_value;
-			rc = os_mbuf_append(ctxt->om, &temp, sizeof(temp));
+			uint8_t temp[TEMP_VALUE_MAX_LEN];
+			uint16_t len = temp_encode(temp);
+			rc = os_mbuf_append(ctxt->om, temp, len);
 			return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
 		}
 		if(attr_handle == led_handle) {
+			uint8_t led_status = led_status_get();
 			rc = os_mbuf_append(ctxt->om,
 								&led_status,
 								sizeof(led_status));
@@ -119,65 +248,693 @@ static int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
 	else if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR)
 	{
 		// Write characteristic value
-		ESP_LOGI(TAG, "Write event; data_len=%d data=", ctxt->om->om_len);
-		esp_log_buffer_hex(TAG, ctxt->om->om_data, ctxt->om->om_len);
+		HOT_LOGI(TAG, "Write event; data_len=%d data=", ctxt->om->om_len);
+		if (HOT_LOG_ENABLED(ESP_LOG_INFO)) {
+			esp_log_buffer_hex(TAG, ctxt->om->om_data, ctxt->om->om_len);
+		}
 		if(attr_handle == led_handle)
 		{
 			rc = gatt_svr_write(ctxt->om,
 								sizeof(gatt_svr_chr_val),
 								sizeof(gatt_svr_chr_val),
 								&gatt_svr_chr_val, NULL);
-			ble_gatts_chr_updated(attr_handle);
+			if (rc != 0) {
+				return rc;
+			}
+			/* Subscribers hear about it once the LED task has switched it. */
 			blink_led(gatt_svr_chr_val);
-			ESP_LOGI(TAG, "Notification/Indication scheduled for "
-						"all subscribed peers.\n");
 		}
 		return 0;
 	}
-	else if (ctxt->op == BLE_GATT_ACCESS_OP_READ_DSC)
-	{
-		// Read descriptor value
-		uint16_t desc_val = htole16(notify_enabled);
-		rc = os_mbuf_append(ctxt->om, &desc_val, sizeof(desc_val));
+	return BLE_ATT_ERR_UNLIKELY;
+}
+
+/* Times every access and traces it; the logging above compiles away
+ * below CONFIG_HOT_LOG_LEVEL.
+ */
+static int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+	uint32_t start = esp_cpu_get_cycle_count();
+	int rc;
+
+	rc = gatt_svr_chr_handle(conn_handle, attr_handle, ctxt);
+	trace_access(conn_handle, attr_handle, ctxt->op, start);
+
+	return rc;
+}
+
+static int gatt_svr_light_read(struct os_mbuf *om)
+{
+	struct led_light light;
+	uint8_t val[LED_LIGHT_LEN] = { 0 };
+
+	led_light_get(&light);
+	val[0] = light.model;
+	if (light.model == LED_MODEL_HSV) {
+		put_le16(&val[1], light.h);
+		val[3] = light.s;
+		val[4] = light.v;
+	} else {
+		memcpy(&val[1], light.rgb, sizeof(light.rgb));
+	}
+	val[5] = light.brightness;
+	put_le16(&val[6], light.transition_ms);
+	val[8] = light.effect;
+
+	return os_mbuf_append(om, val, sizeof(val));
+}
+
+static int gatt_svr_light_write(struct os_mbuf *om)
+{
+	struct led_light light = { 0 };
+	uint8_t val[LED_LIGHT_LEN];
+	int rc;
+
+	rc = gatt_svr_write(om, sizeof(val), sizeof(val), val, NULL);
+	if (rc != 0) {
+		return rc;
+	}
+
+	light.model = val[0];
+	if (light.model == LED_MODEL_HSV) {
+		light.h = get_le16(&val[1]);
+		light.s = val[3];
+		light.v = val[4];
+		if (light.h > 359) {
+			return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+		}
+	} else if (light.model == LED_MODEL_RGB) {
+		memcpy(light.rgb, &val[1], sizeof(light.rgb));
+	} else {
+		return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+	}
+	light.brightness = val[5];
+	light.transition_ms = get_le16(&val[6]);
+	light.effect = val[8];
+	if (light.effect > LED_EFFECT_MAX) {
+		return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+	}
+
+	led_light_set(&light);
+	return 0;
+}
+
+static int gatt_svr_light_access(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+	uint32_t start = esp_cpu_get_cycle_count();
+	int rc;
+
+	switch (ctxt->op) {
+	case BLE_GATT_ACCESS_OP_READ_CHR:
+		rc = gatt_svr_light_read(ctxt->om) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+		break;
+
+	case BLE_GATT_ACCESS_OP_WRITE_CHR:
+		rc = gatt_svr_light_write(ctxt->om);
+		break;
+
+	default:
+		rc = BLE_ATT_ERR_UNLIKELY;
+		break;
+	}
+
+	trace_access(conn_handle, attr_handle, ctxt->op, start);
+	return rc;
+}
+
+/* LED frame scheduler totals since boot, logged with the trace dump. */
+static void gatt_svr_led_report(void)
+{
+	struct led_frame_stats stats;
+
+	led_frame_stats_get(&stats);
+	if (stats.frames == 0) {
+		return;
+	}
+
+	ESP_LOGI(TAG, "LED frames: %lu rendered, %lu missed, render avg %lu max %lu us of %lu us",
+			 (unsigned long)stats.frames, (unsigned long)stats.missed,
+			 (unsigned long)(stats.render_total_us / stats.frames),
+			 (unsigned long)stats.render_max_us, (unsigned long)stats.budget_us);
+}
+
+static int gatt_svr_trace_access(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+	size_t n, skip;
+	int64_t now;
+	uint16_t mtu, chunk;
+	uint8_t cmd;
+	int rc;
+
+	switch (ctxt->op) {
+	case BLE_GATT_ACCESS_OP_READ_CHR:
+		/* The newest records as in struct trace_rec, oldest first, little
+		 * endian, at most one attribute value's worth.
+		 */
+		now = esp_timer_get_time();
+		if (!trace_snap.active || trace_snap.conn_handle != conn_handle ||
+			now - trace_snap.last_us > GATT_SVR_TRACE_READ_US) {
+			n = trace_count();
+			skip = n > GATT_SVR_TRACE_RECS ? n - GATT_SVR_TRACE_RECS : 0;
+			for (size_t i = skip; i < n; i++) {
+				trace_get(i, &trace_snap.recs[i - skip]);
+			}
+			trace_snap.len = (n - skip) * sizeof(struct trace_rec);
+			trace_snap.served = 0;
+			trace_snap.conn_handle = conn_handle;
+			trace_snap.active = true;
+		}
+		trace_snap.last_us = now;
+
+		/* A Read or Read Blob response carries up to MTU - 1 bytes. */
+		mtu = MAX(ble_att_mtu(conn_handle), BLE_ATT_MTU_DFLT);
+		chunk = MIN(mtu - 1, trace_snap.len - trace_snap.served);
+		trace_snap.served += chunk;
+		if (chunk < mtu - 1) {
+			trace_snap.active = false;
+		}
+
+		rc = os_mbuf_append(ctxt->om, trace_snap.recs, trace_snap.len);
 		return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+	case BLE_GATT_ACCESS_OP_WRITE_CHR:
+		rc = gatt_svr_write(ctxt->om, sizeof(cmd), sizeof(cmd), &cmd, NULL);
+		if (rc != 0) {
+			return rc;
+		}
+		if (cmd == 0x01) {
+			trace_dump();
+			gatt_svr_led_report();
+		} else if (cmd == 0x00) {
+			trace_clear();
+		} else {
+			return BLE_ATT_ERR_UNLIKELY;
+		}
+		return 0;
+
+	default:
+		return BLE_ATT_ERR_UNLIKELY;
 	}
-	else if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_DSC)
-	{
-		// Write descriptor value
-		uint16_t desc_val;
-		if (ctxt->om->om_len != 2)
-		{
+}
+
+static int gatt_svr_ind_stats_access(uint16_t conn_handle, uint16_t attr_handle,
+                                     struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+	struct gatt_svr_ind_stats stats = { 0 };
+	uint8_t val[GATT_SVR_IND_STATS_LEN];
+
+	if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+		return BLE_ATT_ERR_UNLIKELY;
+	}
+
+	/* All zero for a peer that is not indicating. */
+	gatt_svr_ind_stats_get(conn_handle, temp_handle, &stats);
+
+	put_le32(&val[0], stats.confirmed);
+	put_le32(&val[4], stats.failed);
+	put_le32(&val[8], stats.coalesced);
+	put_le32(&val[12], stats.rtt_last_us);
+	put_le32(&val[16], stats.rtt_min_us);
+	put_le32(&val[20], stats.confirmed ? stats.rtt_sum_us / stats.confirmed : 0);
+	put_le32(&val[24], stats.rtt_max_us);
+
+	return os_mbuf_append(ctxt->om, val, sizeof(val)) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+/* ES Measurement: how the published value is produced, from the sampling
+ * configuration.
+ */
+static int gatt_svr_es_measurement(struct os_mbuf *om)
+{
+	uint8_t dsc[11];
+	uint32_t period_s = CONFIG_TEMP_FILTER_TAPS * CONFIG_TEMP_SAMPLE_PERIOD_MS / 1000;
+	uint32_t update_s = CONFIG_TEMP_NOTIFY_PERIOD_MS / 1000;
+
+	put_le16(&dsc[0], 0);                 /* flags, reserved */
+#if CONFIG_TEMP_FILTER_MA
+	dsc[2] = 0x02;                        /* sampling function: arithmetic mean */
+#else
+	dsc[2] = 0x00;                        /* sampling function: unspecified */
+#endif
+#if CONFIG_TEMP_FILTER_IIR
+	period_s = 0;                         /* no fixed window */
+#endif
+	put_le24(&dsc[3], period_s);          /* measurement period, s */
+	put_le24(&dsc[6], update_s);          /* internal update interval, s */
+	dsc[9] = 0x00;                        /* application: unspecified */
+	dsc[10] = 0xff;                       /* measurement uncertainty: unknown */
+
+	return os_mbuf_append(om, dsc, sizeof(dsc));
+}
+
+/* ES Trigger Setting: condition, then an interval in seconds (uint24) or
+ * a value in the characteristic's own format, depending on the condition.
+ */
+static int gatt_svr_es_trigger_read(int idx, struct os_mbuf *om)
+{
+	struct temp_trigger t;
+	uint8_t dsc[1 + 3];
+	uint16_t len = 1;
+
+	telemetry_trigger_get(idx, &t);
+	dsc[0] = t.condition;
+
+	if (t.condition == TRIGGER_FIXED_INTERVAL || t.condition == TRIGGER_MIN_INTERVAL) {
+		put_le24(&dsc[1], t.interval_ms / 1000);
+		len += 3;
+	} else if (t.condition >= TRIGGER_LT) {
+#if CONFIG_TEMP_LEGACY_UINT8
+		dsc[1] = (uint8_t)(t.centi / 100);
+		len += 1;
+#else
+		put_le16(&dsc[1], (uint16_t)(int16_t)t.centi);
+		len += 2;
+#endif
+	}
+
+	return os_mbuf_append(om, dsc, len);
+}
+
+static int gatt_svr_es_trigger_write(int idx, struct os_mbuf *om)
+{
+	struct temp_trigger t = { 0 };
+	uint8_t dsc[1 + 3];
+	uint16_t len;
+	int rc;
+
+	rc = gatt_svr_write(om, 1, sizeof(dsc), dsc, &len);
+	if (rc != 0) {
+		return rc;
+	}
+
+	t.condition = dsc[0];
+	if (t.condition == TRIGGER_FIXED_INTERVAL || t.condition == TRIGGER_MIN_INTERVAL) {
+		if (len != 1 + 3) {
 			return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
 		}
-		desc_val = le16toh(ctxt->om->om_data);
-		if (desc_val == 0x0001)
-		{
-			ESP_LOGI(TAG, "Notify enable");
-			notify_enabled = 1;
+		/* Seconds; the timers run in ms and take up to UINT32_MAX of them. */
+		if (get_le24(&dsc[1]) > UINT32_MAX / 1000) {
+			return ESS_ERR_WRITE_REJECTED;
 		}
-		else if (desc_val == 0x0002)
-		{
-			ESP_LOGI(TAG, "Indicate enable");
-			notify_enabled = 2;
+		t.interval_ms = get_le24(&dsc[1]) * 1000;
+	} else if (t.condition >= TRIGGER_LT && t.condition <= TRIGGER_NE) {
+#if CONFIG_TEMP_LEGACY_UINT8
+		if (len != 1 + 1) {
+			return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
 		}
-		else if (desc_val == 0x0000)
-		{
-			ESP_LOGI(TAG, "Notify/indicate disable");
-			notify_enabled = 0;
+		t.centi = (int8_t)dsc[1] * 100;
+#else
+		if (len != 1 + 2) {
+			return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
 		}
-		else
-		{
-			return BLE_ATT_ERR_UNLIKELY;
+		t.centi = (int16_t)get_le16(&dsc[1]);
+#endif
+	} else if (len != 1) {
+		return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+	}
+
+	return telemetry_trigger_set(idx, &t);
+}
+
+static int gatt_svr_es_dsc_access(uint16_t conn_handle, uint16_t attr_handle,
+                                  struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+	uint16_t uuid = ble_uuid_u16(ctxt->dsc->uuid);
+	uint8_t logic;
+	int rc;
+
+	switch (ctxt->op) {
+	case BLE_GATT_ACCESS_OP_READ_DSC:
+		if (uuid == BLE_ES_MEASUREMENT_DESC_UUID) {
+			rc = gatt_svr_es_measurement(ctxt->om);
+		} else if (uuid == BLE_ES_TRIGGER_DESC_UUID) {
+			rc = gatt_svr_es_trigger_read((int)(intptr_t)arg, ctxt->om);
+		} else {
+			logic = telemetry_trigger_logic_get();
+			rc = os_mbuf_append(ctxt->om, &logic, sizeof(logic));
 		}
+		return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+	case BLE_GATT_ACCESS_OP_WRITE_DSC:
+		if (uuid == BLE_ES_TRIGGER_DESC_UUID) {
+			return gatt_svr_es_trigger_write((int)(intptr_t)arg, ctxt->om);
+		}
+
+		/* ES Configuration: how the triggers combine, 0 = AND, 1 = OR. */
+		rc = gatt_svr_write(ctxt->om, sizeof(logic), sizeof(logic), &logic, NULL);
+		if (rc != 0) {
+			return rc;
+		}
+		if (logic > 1) {
+			return ESS_ERR_WRITE_REJECTED;
+		}
+		telemetry_trigger_logic_set(logic);
 		return 0;
+
+	default:
+		return BLE_ATT_ERR_UNLIKELY;
 	}
-	return BLE_ATT_ERR_UNLIKELY;
+}
+
+static struct gatt_svr_sub *gatt_svr_sub_find(uint16_t conn_handle, uint16_t attr_handle)
+{
+	for (int i = 0; i < GATT_SVR_SUBS; i++) {
+		if (subs[i].flags && subs[i].conn_handle == conn_handle &&
+			subs[i].attr_handle == attr_handle) {
+			return &subs[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct gatt_svr_ind *gatt_svr_ind_find(uint16_t conn_handle)
+{
+	for (int i = 0; i < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; i++) {
+		if (inds[i].attr_handle && inds[i].conn_handle == conn_handle) {
+			return &inds[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* The slot is free again; its indication statistics go with it. NimBLE
+ * reports the unsubscribe of a disconnecting peer (reason TERM) before the
+ * disconnect itself, so this is where they are logged.
+ */
+static void gatt_svr_sub_release(struct gatt_svr_sub *sub)
+{
+	if (sub->stats.confirmed) {
+		ESP_LOGI(TAG, "Indications to conn_handle=%d attr_handle=%d: %lu confirmed, "
+				 "rtt %lu/%lu/%lu us min/avg/max, %lu coalesced, %lu failed",
+				 sub->conn_handle, sub->attr_handle,
+				 (unsigned long)sub->stats.confirmed,
+				 (unsigned long)sub->stats.rtt_min_us,
+				 (unsigned long)(sub->stats.rtt_sum_us / sub->stats.confirmed),
+				 (unsigned long)sub->stats.rtt_max_us,
+				 (unsigned long)sub->stats.coalesced,
+				 (unsigned long)sub->stats.failed);
+	}
+	sub->flags = 0;
+	sub->pending_len = 0;
+}
+
+void gatt_svr_subscribe(uint16_t conn_handle, uint16_t attr_handle, uint8_t flags)
+{
+	struct gatt_svr_sub *sub = gatt_svr_sub_find(conn_handle, attr_handle);
+
+	if (sub == NULL && flags) {
+		/* A free slot; there is one per connection and characteristic. */
+		for (int i = 0; sub == NULL && i < GATT_SVR_SUBS; i++) {
+			if (!subs[i].flags) {
+				sub = &subs[i];
+			}
+		}
+		if (sub == NULL) {
+			ESP_LOGW(TAG, "No subscription slot for conn_handle=%d", conn_handle);
+			return;
+		}
+		memset(sub, 0, sizeof(*sub));
+		sub->conn_handle = conn_handle;
+		sub->attr_handle = attr_handle;
+	}
+
+	if (sub == NULL) {
+		return;
+	}
+
+	if (flags) {
+		sub->flags = flags;
+	} else {
+		gatt_svr_sub_release(sub);
+	}
+}
+
+void gatt_svr_disconnect(uint16_t conn_handle)
+{
+	struct gatt_svr_ind *ind = gatt_svr_ind_find(conn_handle);
+
+	if (ind != NULL) {
+		ind->attr_handle = 0;
+	}
+
+	for (int i = 0; i < GATT_SVR_SUBS; i++) {
+		if (subs[i].flags && subs[i].conn_handle == conn_handle) {
+			gatt_svr_sub_release(&subs[i]);
+		}
+	}
+}
+
+uint8_t gatt_svr_sub_flags(uint16_t conn_handle, uint16_t attr_handle)
+{
+	struct gatt_svr_sub *sub = gatt_svr_sub_find(conn_handle, attr_handle);
+
+	return sub ? sub->flags : 0;
+}
+
+int gatt_svr_subscribers(uint16_t attr_handle)
+{
+	int n = 0;
+
+	for (int i = 0; i < GATT_SVR_SUBS; i++) {
+		if (subs[i].flags && subs[i].attr_handle == attr_handle) {
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/* Low-water marks are sampled around every send; msys has no counter of
+ * its own.
+ */
+static void gatt_svr_mbuf_sample(void)
+{
+	int msys_free = os_msys_num_free();
+
+	if (msys_free < mbuf_stats.msys_min_free) {
+		mbuf_stats.msys_min_free = msys_free;
+	}
+}
+
+static struct os_mbuf *gatt_svr_mbuf_get(const void *data, uint16_t len)
+{
+	struct os_mbuf *om;
+
+	om = os_mbuf_get_pkthdr(&notify_mbuf_pool, sizeof(struct ble_mbuf_hdr));
+	if (om == NULL) {
+		mbuf_stats.reserved_failures++;
+		return NULL;
+	}
+
+	/* Fits in the block: len was checked against GATT_SVR_VALUE_MAX. */
+	os_mbuf_append(om, data, len);
+	return om;
+}
+
+/* A free slot is certain: the connection had nothing in flight. */
+static void gatt_svr_ind_start(const struct gatt_svr_sub *sub)
+{
+	for (int i = 0; i < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; i++) {
+		if (!inds[i].attr_handle) {
+			inds[i].conn_handle = sub->conn_handle;
+			inds[i].attr_handle = sub->attr_handle;
+			inds[i].sent_us = esp_timer_get_time();
+			return;
+		}
+	}
+}
+
+static int gatt_svr_send(struct gatt_svr_sub *sub, const void *data, uint16_t len)
+{
+	struct os_mbuf *om;
+	int rc;
+
+	if (len > GATT_SVR_VALUE_MAX) {
+		return BLE_HS_EINVAL;
+	}
+
+	if ((sub->flags & GATT_SVR_SUB_INDICATE) && gatt_svr_ind_find(sub->conn_handle)) {
+		if (sub->pending_len) {
+			sub->stats.coalesced++;
+		}
+		memcpy(sub->pending, data, len);
+		sub->pending_len = len;
+		return 0;
+	}
+
+	/* The stack consumes the mbuf on success and failure alike, so every
+	 * peer gets its own and nothing is left to free here. It is only
+	 * taken once the value is certain to go out.
+	 */
+	om = gatt_svr_mbuf_get(data, len);
+	if (om == NULL) {
+		return BLE_HS_ENOMEM;
+	}
+
+	if (sub->flags & GATT_SVR_SUB_INDICATE) {
+		rc = ble_gattc_indicate_custom(sub->conn_handle, sub->attr_handle, om);
+		if (rc == 0) {
+			gatt_svr_ind_start(sub);
+		}
+	} else {
+		rc = ble_gattc_notify_custom(sub->conn_handle, sub->attr_handle, om);
+	}
+	gatt_svr_mbuf_sample();
+	if (rc == BLE_HS_ENOMEM) {
+		/* The ATT header mbuf comes from msys. */
+		mbuf_stats.msys_failures++;
+	}
+	if (rc != 0) {
+		ESP_LOGW(TAG, "%s to conn_handle=%d failed; rc=%d",
+				 sub->flags & GATT_SVR_SUB_INDICATE ? "Indication" : "Notification",
+				 sub->conn_handle, rc);
+	}
+
+	return rc;
+}
+
+int gatt_svr_notify(uint16_t attr_handle, const void *data, uint16_t len)
+{
+	int n = 0;
+
+	for (int i = 0; i < GATT_SVR_SUBS; i++) {
+		if (subs[i].flags && subs[i].attr_handle == attr_handle &&
+			gatt_svr_send(&subs[i], data, len) == 0) {
+			n++;
+		}
+	}
+
+	return n;
+}
+
+int gatt_svr_notify_conn(uint16_t conn_handle, uint16_t attr_handle,
+                         const void *data, uint16_t len)
+{
+	struct gatt_svr_sub *sub = gatt_svr_sub_find(conn_handle, attr_handle);
+
+	return sub != NULL && gatt_svr_send(sub, data, len) == 0;
+}
+
+void gatt_svr_notify_tx(uint16_t conn_handle, uint16_t attr_handle, int status)
+{
+	struct gatt_svr_ind *ind = gatt_svr_ind_find(conn_handle);
+	struct gatt_svr_sub *sub;
+	uint32_t rtt_us;
+	int start = 0;
+
+	/* Status 0 only says the indication went out; wait for the peer. */
+	if (ind == NULL || ind->attr_handle != attr_handle || status == 0) {
+		return;
+	}
+
+	rtt_us = esp_timer_get_time() - ind->sent_us;
+	ind->attr_handle = 0;
+
+	/* The peer may have unsubscribed meanwhile. */
+	sub = gatt_svr_sub_find(conn_handle, attr_handle);
+	if (sub != NULL) {
+		if (status == BLE_HS_EDONE) {
+			if (sub->stats.confirmed == 0 || rtt_us < sub->stats.rtt_min_us) {
+				sub->stats.rtt_min_us = rtt_us;
+			}
+			if (rtt_us > sub->stats.rtt_max_us) {
+				sub->stats.rtt_max_us = rtt_us;
+			}
+			sub->stats.rtt_last_us = rtt_us;
+			sub->stats.rtt_sum_us += rtt_us;
+			sub->stats.confirmed++;
+		} else {
+			sub->stats.failed++;
+		}
+		start = sub - subs + 1;
+	}
+
+	/* The connection's next pending value, taking the subscriptions in
+	 * turn from the one just confirmed so none of them starves. One that
+	 * does not go out as an indication leaves the way to the next.
+	 */
+	for (int i = 0; i < GATT_SVR_SUBS; i++) {
+		struct gatt_svr_sub *next = &subs[(start + i) % GATT_SVR_SUBS];
+
+		if (next->flags && next->conn_handle == conn_handle && next->pending_len) {
+			uint8_t value[GATT_SVR_VALUE_MAX];
+			uint16_t len = next->pending_len;
+
+			memcpy(value, next->pending, len);
+			next->pending_len = 0;
+			gatt_svr_send(next, value, len);
+			if (gatt_svr_ind_find(conn_handle)) {
+				break;
+			}
+		}
+	}
+}
+
+int gatt_svr_ind_stats_get(uint16_t conn_handle, uint16_t attr_handle,
+                           struct gatt_svr_ind_stats *stats)
+{
+	struct gatt_svr_sub *sub = gatt_svr_sub_find(conn_handle, attr_handle);
+
+	if (sub == NULL) {
+		return BLE_HS_ENOTCONN;
+	}
+
+	*stats = sub->stats;
+	return 0;
+}
+
+void gatt_svr_mbuf_stats_get(struct gatt_svr_mbuf_stats *stats)
+{
+	*stats = mbuf_stats;
+	stats->reserved_free = notify_mempool.mp_num_free;
+	stats->reserved_min_free = notify_mempool.mp_min_free;
+	stats->msys_free = os_msys_num_free();
+}
+
+/* Host task. */
+static void gatt_svr_led_changed(struct ble_npl_event *ev)
+{
+	uint8_t on = led_status_get();
+	int peers;
+
+	/* Same path as telemetry: reserved pool, one indication in flight. */
+	peers = gatt_svr_notify(led_handle, &on, sizeof(on));
+	trace(TRACE_NOTIFY, BLE_HS_CONN_HANDLE_NONE, led_handle, 0, peers);
+	HOT_LOGI(TAG, "LED state %u sent to %d subscribed peers", on, peers);
+}
+
+/* LED task: hand over to the host. */
+static void gatt_svr_led_changed_cb(uint8_t on)
+{
+	ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &led_changed_ev);
 }
 
 int gatt_svr_init(void)
 {
     int rc;
 
+    rc = os_mempool_init(&notify_mempool, CONFIG_GATT_NOTIFY_MBUFS, GATT_SVR_MBUF_SIZE,
+                         notify_mbuf_mem, "gatt_notify");
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = os_mbuf_pool_init(&notify_mbuf_pool, &notify_mempool, GATT_SVR_MBUF_SIZE,
+                           CONFIG_GATT_NOTIFY_MBUFS);
+    if (rc != 0) {
+        return rc;
+    }
+
+    mbuf_stats.msys_min_free = os_msys_num_free();
+
+    ble_npl_event_init(&led_changed_ev, gatt_svr_led_changed, NULL);
+    led_set_changed_handler(gatt_svr_led_changed_cb);
+
     ble_svc_gap_init();
     ble_svc_gatt_init();
 
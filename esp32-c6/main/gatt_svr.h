@@ -8,11 +8,74 @@
 #ifndef MAIN_GATT_SVR_H_
 #define MAIN_GATT_SVR_H_
 
+#include <stdint.h>
+
 #include "nimble/ble.h"
 
 #define BLE_UUID_ENVIRONMENTAL_SENSING_SERVICE        0x181A // environmental sensing service uuid
 #define BLE_UUID_TEMPERATURE_CHAR                     0x2A6E     /**< temperature characteristic UUID. */
+#define CUSTOM_IND_STATS_CHAR_UUID                    0x567B // Indication statistics, custom service
+
+/* Indication statistics value: the reading peer's own temperature
+ * indications, as uint32 little endian: confirmed | failed | coalesced |
+ * rtt last | rtt min | rtt avg | rtt max (us).
+ */
+#define GATT_SVR_IND_STATS_LEN 28
+
+/* Subscription flags of one peer to one characteristic, as in its CCCD. */
+#define GATT_SVR_SUB_NOTIFY   0x01
+#define GATT_SVR_SUB_INDICATE 0x02
+
+/* Indications to one peer for one characteristic, since it subscribed. */
+struct gatt_svr_ind_stats {
+	uint32_t confirmed;
+	uint32_t failed;      /* timed out or not sent */
+	uint32_t coalesced;   /* pending values replaced by a newer one */
+	uint32_t rtt_last_us; /* indication to confirmation */
+	uint32_t rtt_min_us;
+	uint32_t rtt_max_us;
+	uint64_t rtt_sum_us;
+};
 
 int gatt_svr_init(void);
 
+/* Buffers of the notification path. */
+struct gatt_svr_mbuf_stats {
+	uint16_t reserved_free;      /* reserved notification mbufs */
+	uint16_t reserved_min_free;
+	uint32_t reserved_failures;  /* values dropped, no reserved mbuf */
+	int msys_free;               /* host msys blocks */
+	int msys_min_free;
+	uint32_t msys_failures;      /* values dropped, no msys block for the header */
+};
+
+/* Record the CCCD of conn_handle for attr_handle (flags 0 unsubscribes).
+ * Called from the GAP subscribe event.
+ */
+void gatt_svr_subscribe(uint16_t conn_handle, uint16_t attr_handle, uint8_t flags);
+
+/* Drop every subscription of conn_handle. */
+void gatt_svr_disconnect(uint16_t conn_handle);
+
+uint8_t gatt_svr_sub_flags(uint16_t conn_handle, uint16_t attr_handle);
+int gatt_svr_subscribers(uint16_t attr_handle);
+
+/* Notify or indicate data, as each peer subscribed, to every connection
+ * subscribed to attr_handle, or to conn_handle only. Returns the number
+ * of peers the value went out to.
+ */
+int gatt_svr_notify(uint16_t attr_handle, const void *data, uint16_t len);
+int gatt_svr_notify_conn(uint16_t conn_handle, uint16_t attr_handle,
+                         const void *data, uint16_t len);
+
+/* BLE_GAP_EVENT_NOTIFY_TX of an indication: account for the confirmation
+ * and send the connection's next pending value, if any.
+ */
+void gatt_svr_notify_tx(uint16_t conn_handle, uint16_t attr_handle, int status);
+
+void gatt_svr_mbuf_stats_get(struct gatt_svr_mbuf_stats *stats);
+
+int gatt_svr_ind_stats_get(uint16_t conn_handle, uint16_t attr_handle,
+                           struct gatt_svr_ind_stats *stats);
+
 #endif /* MAIN_GATT_SVR_H_ */
@@ -8,14 +8,244 @@
 #ifndef MAIN_LED_C_
 #define MAIN_LED_C_
 
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
 #include "led.h"
 #include "esp_log.h"
+#include "trace.h"
 
 #define TAG "Nimble_ble_PRPH-led"
 #define BLINK_GPIO CONFIG_BLINK_GPIO
 
+#define LED_TASK_STACK 3072
+#define LED_TASK_PRIO  4
+
+#define FRAME_US (1000000 / CONFIG_LED_FRAME_RATE_HZ)
+
+/* Effect periods, in frames. */
+#define BLINK_FRAMES   MAX(1, CONFIG_LED_FRAME_RATE_HZ / 2)
+#define BREATHE_FRAMES MAX(2, 2 * CONFIG_LED_FRAME_RATE_HZ)
+#define CYCLE_FRAMES   (6 * CONFIG_LED_FRAME_RATE_HZ)
+
+/* The LED task owns the strip. Writes post the requested light to a
+ * one-slot queue, a newer request replacing one not yet taken, so the
+ * caller never waits on the RMT transfer. While a transition or an
+ * effect runs, the task renders a frame every FRAME_US and otherwise
+ * sleeps on the queue.
+ */
 static led_strip_handle_t led_strip;
-uint8_t led_status = 0;
+static QueueHandle_t led_queue;
+static atomic_uchar led_status;
+static void (*changed_handler)(uint8_t on);
+static struct led_light requested;
+
+/* LED task only. Colours are after brightness. */
+static struct {
+	uint8_t from[3];
+	uint8_t to[3];
+	uint8_t base[3];       /* last transition colour rendered */
+	uint32_t frame;        /* frames since the request */
+	uint32_t frames;       /* transition length */
+	uint8_t effect;
+	bool running;
+} anim;
+
+static struct led_frame_stats frame_stats;
+
+void led_hsv_to_rgb(uint16_t h, uint8_t s, uint8_t v, uint8_t rgb[3])
+{
+	uint8_t region = h / 60;
+	uint32_t f = (h % 60) * 255 / 60;
+	uint8_t p = v * (255 - s) / 255;
+	uint8_t q = v * (255 - s * f / 255) / 255;
+	uint8_t t = v * (255 - s * (255 - f) / 255) / 255;
+
+	switch (region) {
+	case 0:  rgb[0] = v; rgb[1] = t; rgb[2] = p; break;
+	case 1:  rgb[0] = q; rgb[1] = v; rgb[2] = p; break;
+	case 2:  rgb[0] = p; rgb[1] = v; rgb[2] = t; break;
+	case 3:  rgb[0] = p; rgb[1] = q; rgb[2] = v; break;
+	case 4:  rgb[0] = t; rgb[1] = p; rgb[2] = v; break;
+	default: rgb[0] = v; rgb[1] = p; rgb[2] = q; break;
+	}
+}
+
+static void led_start(const struct led_light *light)
+{
+	uint8_t rgb[3];
+
+	if (light->model == LED_MODEL_HSV) {
+		led_hsv_to_rgb(light->h, light->s, light->v, rgb);
+	} else {
+		memcpy(rgb, light->rgb, sizeof(rgb));
+	}
+
+	for (int i = 0; i < 3; i++) {
+		anim.from[i] = anim.base[i];
+		anim.to[i] = rgb[i] * light->brightness / 255;
+	}
+	anim.frame = 0;
+	anim.frames = (uint32_t)light->transition_ms * CONFIG_LED_FRAME_RATE_HZ / 1000;
+	anim.effect = light->effect;
+	anim.running = true;
+}
+
+/* Effect on top of the transition colour, from the frame count. */
+static void led_effect(const uint8_t base[3], uint8_t px[3])
+{
+	uint32_t phase;
+	uint32_t level = 255;
+	uint8_t v;
+
+	switch (anim.effect) {
+	case LED_EFFECT_BLINK:
+		if ((anim.frame / BLINK_FRAMES) & 1) {
+			level = 0;
+		}
+		break;
+
+	case LED_EFFECT_BREATHE:
+		phase = anim.frame % BREATHE_FRAMES;
+		if (phase >= BREATHE_FRAMES / 2) {
+			phase = BREATHE_FRAMES - phase;
+		}
+		level = phase * 255 / (BREATHE_FRAMES / 2);
+		break;
+
+	case LED_EFFECT_CYCLE:
+		v = MAX(base[0], MAX(base[1], base[2]));
+		led_hsv_to_rgb(anim.frame % CYCLE_FRAMES * 360 / CYCLE_FRAMES, 255, v, px);
+		return;
+
+	default:
+		break;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		px[i] = base[i] * level / 255;
+	}
+}
+
+static void led_settled(uint8_t on)
+{
+	/* The strip has been refreshed; only now report the change. */
+	if (atomic_exchange(&led_status, on) != on && changed_handler) {
+		changed_handler(on);
+	}
+	trace(TRACE_LED, 0, 0, anim.effect, on);
+}
+
+static void led_frame(void)
+{
+	uint8_t px[3];
+	int64_t start;
+	uint32_t render_us;
+
+	for (int i = 0; i < 3; i++) {
+		if (anim.frame >= anim.frames) {
+			anim.base[i] = anim.to[i];
+		} else {
+			anim.base[i] = anim.from[i] +
+				((int)anim.to[i] - anim.from[i]) * (int)anim.frame / (int)anim.frames;
+		}
+	}
+	led_effect(anim.base, px);
+
+	start = esp_timer_get_time();
+	if (px[0] | px[1] | px[2]) {
+		led_strip_set_pixel(led_strip, 0, px[0], px[1], px[2]);
+		/* Refresh the strip to send data */
+		led_strip_refresh(led_strip);
+	} else {
+		/* Set all LED off to clear all pixels */
+		led_strip_clear(led_strip);
+	}
+	render_us = esp_timer_get_time() - start;
+
+	frame_stats.frames++;
+	frame_stats.render_total_us += render_us;
+	if (render_us > frame_stats.render_max_us) {
+		frame_stats.render_max_us = render_us;
+	}
+
+	if (anim.frame == anim.frames) {
+		led_settled((anim.base[0] | anim.base[1] | anim.base[2]) != 0);
+		if (anim.effect == LED_EFFECT_NONE) {
+			anim.running = false;
+		}
+	}
+	anim.frame++;
+}
+
+/* Once per finished transition, so a plain log is cheap enough. */
+static void led_report(void)
+{
+	if (frame_stats.frames == 0) {
+		return;
+	}
+
+	ESP_LOGI(TAG, "Frames: %lu rendered, %lu missed, render avg %lu max %lu us of %lu us",
+			 (unsigned long)frame_stats.frames, (unsigned long)frame_stats.missed,
+			 (unsigned long)(frame_stats.render_total_us / frame_stats.frames),
+			 (unsigned long)frame_stats.render_max_us,
+			 (unsigned long)frame_stats.budget_us);
+}
+
+static void led_task(void *param)
+{
+	struct led_light light;
+	int64_t next_us = 0;
+	int64_t now;
+	TickType_t wait;
+
+	for (;;) {
+		wait = portMAX_DELAY;
+		if (anim.running) {
+			now = esp_timer_get_time();
+			/* Rounded up to whole ticks: at 100 Hz a 20 ms frame is 2 ticks
+			 * and a wait of a few ms is 1, never 0, which would spin.
+			 */
+			wait = next_us > now ?
+				(TickType_t)(((next_us - now) * configTICK_RATE_HZ + 999999) / 1000000) : 0;
+		}
+
+		if (xQueueReceive(led_queue, &light, wait) == pdTRUE) {
+			led_start(&light);
+			next_us = esp_timer_get_time();
+			continue;
+		}
+
+		now = esp_timer_get_time();
+		if (!anim.running || now < next_us) {
+			continue;
+		}
+
+		led_frame();
+		if (!anim.running) {
+			led_report();
+			continue;
+		}
+
+		/* Keep the frame grid; count the frames there was no time for. */
+		next_us += FRAME_US;
+		now = esp_timer_get_time();
+		if (next_us <= now) {
+			uint32_t behind = (now - next_us) / FRAME_US + 1;
+
+			frame_stats.missed += behind;
+			next_us += (int64_t)behind * FRAME_US;
+		}
+	}
+}
 
 void configure_led(void)
 {
@@ -31,26 +261,50 @@ void configure_led(void)
     ESP_ERROR_CHECK(led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip));
     /* Set all LED off to clear all pixels */
     led_strip_clear(led_strip);
+
+    frame_stats.budget_us = FRAME_US;
+
+    led_queue = xQueueCreate(1, sizeof(struct led_light));
+    assert(led_queue != NULL);
+    xTaskCreate(led_task, "led", LED_TASK_STACK, NULL, LED_TASK_PRIO, NULL);
 }
 
 void blink_led(uint8_t set_led_status)
 {
-	if(set_led_status)
-	{
-	    ESP_LOGI(TAG, "Turning On LED!\n");
+	/* The plain on/off LED: dim white, switched at once. */
+	struct led_light light = {
+		.model = LED_MODEL_RGB,
+		.rgb = { 255, 255, 255 },
+		.brightness = set_led_status ? 16 : 0,
+	};
 
-		led_strip_set_pixel(led_strip, 0, 16, 16, 16);
-		/* Refresh the strip to send data */
-		led_strip_refresh(led_strip);
-		led_status = 1;
-	}else
-	{
-	    ESP_LOGI(TAG, "Turning Off LED!\n");
-
-        /* Set all LED off to clear all pixels */
-        led_strip_clear(led_strip);
-        led_status = 0;
-    }
+	led_light_set(&light);
+}
+
+void led_light_set(const struct led_light *light)
+{
+	requested = *light;
+	xQueueOverwrite(led_queue, light);
+}
+
+void led_light_get(struct led_light *light)
+{
+	*light = requested;
+}
+
+uint8_t led_status_get(void)
+{
+	return atomic_load(&led_status);
+}
+
+void led_set_changed_handler(void (*handler)(uint8_t on))
+{
+	changed_handler = handler;
+}
+
+void led_frame_stats_get(struct led_frame_stats *stats)
+{
+	*stats = frame_stats;
 }
 
 #endif /* MAIN_LED_C_ */
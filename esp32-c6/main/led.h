@@ -8,12 +8,69 @@
 #ifndef MAIN_LED_H_
 #define MAIN_LED_H_
 
+#include <stdint.h>
+
 #include "led_strip.h"
 
 #define CUSTOM_SERVICE_UUID 0x1234 // Custom Service
 #define CUSTOM_LED_CHAR_UUID 0x5678 // Custom LED Characteristic
+#define CUSTOM_LIGHT_CHAR_UUID 0x567A // Custom Lighting Control Characteristic
+
+/* Lighting Control value: model | colour (4) | brightness | transition ms
+ * (uint16) | effect, little endian. The colour is r, g, b, 0 for RGB and
+ * h (uint16, 0-359), s, v for HSV.
+ */
+#define LED_LIGHT_LEN 9
+
+#define LED_MODEL_RGB 0
+#define LED_MODEL_HSV 1
+
+#define LED_EFFECT_NONE    0
+#define LED_EFFECT_BLINK   1 /* 1 Hz */
+#define LED_EFFECT_BREATHE 2 /* 2 s period */
+#define LED_EFFECT_CYCLE   3 /* hue round in 6 s */
+#define LED_EFFECT_MAX     LED_EFFECT_CYCLE
+
+struct led_light {
+	uint8_t model;
+	uint8_t rgb[3];          /* LED_MODEL_RGB */
+	uint16_t h;              /* LED_MODEL_HSV */
+	uint8_t s;
+	uint8_t v;
+	uint8_t brightness;
+	uint16_t transition_ms;
+	uint8_t effect;
+};
+
+/* Frame scheduler, since boot. */
+struct led_frame_stats {
+	uint32_t frames;
+	uint32_t missed;          /* frame slots skipped for lack of time */
+	uint32_t budget_us;       /* one frame at CONFIG_LED_FRAME_RATE_HZ */
+	uint64_t render_total_us; /* strip update, per frame */
+	uint32_t render_max_us;
+};
 
+/* Set up the strip and start the LED task that owns it. */
 void configure_led(void);
+
+/* Ask the LED task to switch the LED; returns right away. */
 void blink_led(uint8_t set_led_status);
 
+/* Ask the LED task for a light, transition and effect; returns right
+ * away. get() returns the last one asked for.
+ */
+void led_light_set(const struct led_light *light);
+void led_light_get(struct led_light *light);
+
+/* State the LED was last actually switched to, 0 or 1. */
+uint8_t led_status_get(void);
+
+/* Called from the LED task after the strip has changed state. */
+void led_set_changed_handler(void (*handler)(uint8_t on));
+
+void led_frame_stats_get(struct led_frame_stats *stats);
+
+void led_hsv_to_rgb(uint16_t h, uint8_t s, uint8_t v, uint8_t rgb[3]);
+
 #endif /* MAIN_LED_H_ */
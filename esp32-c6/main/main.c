@@ -18,47 +18,19 @@
 #include "led.h"
 #include "temp.h"
 #include "gatt_svr.h"
+#include "telemetry.h"
+#include "trace.h"
 
 #define TAG "BLE_PRPHRL"
 #define DEVICE_NAME Nimble_ble_PRPHL
 /* BLE Variables */
-static uint16_t conn_handle;
 static const char *DEVICE_NAME = "Nimble_ble_PRPH";
 
 extern uint16_t temp_handle; // Characteristic handle
-static uint16_t conn_handle; // Connection handle
-static bool device_connected = false; // Connection status
-static uint8_t notify_enabled = 0; // Notification status
+static int conn_count; // Connected centrals, up to CONFIG_BT_NIMBLE_MAX_CONNECTIONS
 
 static int ble_prphl_gap_event(struct ble_gap_event *event, void *arg);
-
-static void notify_temperature()
-{
-	if (device_connected)
-	{
-		int rc;
-		float temp_value = read_temperature();
-		uint8_t temp = (uint8_t)temp_value;
-		ESP_LOGI(TAG, "=------>Reading %d\n", temp);
-        struct os_mbuf *om = ble_hs_mbuf_from_flat(&temp, sizeof(temp)); // Create an mbuf for the characteristic value
-
-		if (notify_enabled == 1)
-		{
-			// Send notification
-			rc = ble_gattc_notify_custom(conn_handle, temp_handle, om);
-			assert(rc == 0);
-		}
-		else if (notify_enabled == 2)
-		{
-			// Send indication
-			rc = ble_gattc_indicate_custom(conn_handle, temp_handle, om);
-			assert(rc == 0);
-		}
-		ESP_LOGI(TAG, "Temperature: %d C", temp); // Print temperature to console
-
-		vTaskDelay(5000 / portTICK_PERIOD_MS);     // Wait 5 seconds
-	}
-}
+void ble_store_config_init(void);
 
 static int ble_prphl_advertise()
 {
@@ -130,19 +102,27 @@ static int ble_prphl_gap_event(struct ble_gap_event *event, void *arg)
 				 event->connect.status);
 		if (event->connect.status == 0)
 		{
-			conn_handle = event->connect.conn_handle;
-			device_connected = true;
+			conn_count++;
+		}
+		// Keep advertising while there is room for another central
+		if (conn_count < CONFIG_BT_NIMBLE_MAX_CONNECTIONS && !ble_gap_adv_active())
+		{
+			ble_prphl_advertise();
 		}
 		break;
 
 	case BLE_GAP_EVENT_DISCONNECT:
 		// Connection terminated
-		ESP_LOGI(TAG, "disconnect; reason=%d ", event->disconnect.reason);
-		conn_handle = BLE_HS_CONN_HANDLE_NONE;
-		device_connected = false;
-		notify_enabled = 0;
-		// Restart advertising
-		ble_prphl_advertise();
+		ESP_LOGI(TAG, "disconnect; conn_handle=%d reason=%d ",
+				 event->disconnect.conn.conn_handle, event->disconnect.reason);
+		conn_count--;
+		gatt_svr_disconnect(event->disconnect.conn.conn_handle);
+		telemetry_stop();
+		// Restart advertising, unless still advertising for a free slot
+		if (!ble_gap_adv_active())
+		{
+			ble_prphl_advertise();
+		}
 		break;
 
 	case BLE_GAP_EVENT_ADV_COMPLETE:
@@ -163,35 +143,63 @@ static int ble_prphl_gap_event(struct ble_gap_event *event, void *arg)
 				 event->subscribe.cur_notify,
 				 event->subscribe.prev_indicate,
 				 event->subscribe.cur_indicate);
+		trace(TRACE_SUBSCRIBE, event->subscribe.conn_handle, event->subscribe.attr_handle, 0,
+			  (event->subscribe.cur_notify ? GATT_SVR_SUB_NOTIFY : 0) |
+			  (event->subscribe.cur_indicate ? GATT_SVR_SUB_INDICATE : 0));
+		gatt_svr_subscribe(event->subscribe.conn_handle,
+						   event->subscribe.attr_handle,
+						   (event->subscribe.cur_notify ? GATT_SVR_SUB_NOTIFY : 0) |
+						   (event->subscribe.cur_indicate ? GATT_SVR_SUB_INDICATE : 0));
 		if (event->subscribe.attr_handle == temp_handle)
 		{
-			if (event->subscribe.cur_notify)
-			{
-				ESP_LOGI(TAG, "---> Notify enable");
-				notify_enabled = 1;
-				notify_temperature();
-			}
-			else if (event->subscribe.cur_indicate)
+			if (event->subscribe.cur_notify || event->subscribe.cur_indicate)
 			{
-				ESP_LOGI(TAG, "-----> Indicate enable");
-				notify_enabled = 2;
+				ESP_LOGI(TAG, "---> %s enable",
+						 event->subscribe.cur_indicate ? "Indicate" : "Notify");
+				telemetry_start(event->subscribe.conn_handle);
 			}
 			else
 			{
 				ESP_LOGI(TAG, "----> Notify/indicate disable");
-				notify_enabled = 0;
+				telemetry_stop();
 			}
 		}
 		break;
 
+	case BLE_GAP_EVENT_ENC_CHANGE:
+		// Encryption started, from a new pairing or a stored bond
+		ESP_LOGI(TAG, "encryption change; conn_handle=%d status=%d ",
+				 event->enc_change.conn_handle, event->enc_change.status);
+		break;
+
+	case BLE_GAP_EVENT_REPEAT_PAIRING:
+		// The relay lost its bond and pairs again: drop the old one
+		{
+			struct ble_gap_conn_desc desc;
+
+			if (ble_gap_conn_find(event->repeat_pairing.conn_handle, &desc) == 0)
+			{
+				ble_store_util_delete_peer(&desc.peer_id_addr);
+			}
+		}
+		return BLE_GAP_REPEAT_PAIRING_RETRY;
+
 	case BLE_GAP_EVENT_NOTIFY_TX:
 		// GATT notification/indication event
-		ESP_LOGI(TAG, "notify event; conn_handle=%d attr_handle=%d "
+		trace(TRACE_NOTIFY_TX, event->notify_tx.conn_handle, event->notify_tx.attr_handle,
+			  event->notify_tx.indication, event->notify_tx.status);
+		HOT_LOGI(TAG, "notify event; conn_handle=%d attr_handle=%d "
 					  "status=%d indication=%d",
 				 event->notify_tx.conn_handle,
 				 event->notify_tx.attr_handle,
 				 event->notify_tx.status,
 				 event->notify_tx.indication);
+		if (event->notify_tx.indication)
+		{
+			gatt_svr_notify_tx(event->notify_tx.conn_handle,
+							   event->notify_tx.attr_handle,
+							   event->notify_tx.status);
+		}
 		break;
 
 	default:
@@ -251,6 +259,16 @@ void app_main(void)
 	ble_hs_cfg.reset_cb = ble_prphl_on_reset;
     ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
 
+	/* Bond (Just Works) with the relay, which reconnects on the stored LTK
+	 * and relies on the CCCDs being kept for the bond.
+	 */
+	ble_hs_cfg.sm_io_cap = BLE_SM_IO_CAP_NO_IO;
+	ble_hs_cfg.sm_bonding = 1;
+	ble_hs_cfg.sm_sc = 1;
+	ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+	ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+	ble_store_config_init();
+
 	/* Configure the peripheral according to the LED type */
 	configure_led();
 
@@ -261,6 +279,9 @@ void app_main(void)
 	rc = temp_sensor_init();
 	assert(rc == 0);
 
+	rc = telemetry_init();
+	assert(rc == 0);
+
 
 	nimble_port_freertos_init(ble_temp_prph_host_task);
 
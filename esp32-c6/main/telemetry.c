@@ -0,0 +1,417 @@
+/*
+ * telemetry.c
+ *
+ *  Notifications are driven by the ESS Trigger Settings. Interval triggers
+ *  run an esp_timer; value triggers program the sensor's hardware
+ *  thresholds around the current value and wait for its interrupt. Both
+ *  post an event to the host's default event queue, and the host task
+ *  checks the triggers against the latest cached sample and, only if they
+ *  hold, sends it to every subscribed peer, so neither the GAP callback
+ *  nor the host ever waits on a period or on the sensor.
+ */
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/param.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host/ble_hs.h"
+#include "nimble/nimble_port.h"
+
+#include "gatt_svr.h"
+#include "temp.h"
+#include "telemetry.h"
+#include "trace.h"
+
+#define TAG "Nimble_ble_PRPH-telemetry"
+
+/* Range the hardware thresholds are kept in, 0.01 degree units. */
+#define WINDOW_MIN_CENTI (-1000)
+#define WINDOW_MAX_CENTI 5000
+
+/* A timer tick may come slightly early; still count it as due. */
+#define TICK_SLACK_US 10000
+
+/* About how long the filter takes to follow a step in the raw readings. */
+#if CONFIG_TEMP_FILTER_IIR
+#define FILTER_SETTLE_MS ((1 << CONFIG_TEMP_FILTER_IIR_SHIFT) * CONFIG_TEMP_SAMPLE_PERIOD_MS)
+#else
+#define FILTER_SETTLE_MS (CONFIG_TEMP_FILTER_TAPS * CONFIG_TEMP_SAMPLE_PERIOD_MS)
+#endif
+
+enum {
+	EV_SUBSCRIBE,
+	EV_TICK,
+	EV_THRESHOLD,
+	EV_SETTLE,
+};
+
+extern uint16_t temp_handle;
+
+static esp_timer_handle_t tick_timer;
+static esp_timer_handle_t settle_timer;
+static struct ble_npl_event subscribe_ev;
+static struct ble_npl_event tick_ev;
+static struct ble_npl_event threshold_ev;
+static struct ble_npl_event settle_ev;
+
+/* Threshold interrupts are ignored while the filter catches up. */
+static atomic_bool threshold_masked;
+
+/* Peers that subscribed since the last subscribe event. */
+static uint16_t first_conn[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+static int first_count;
+
+static struct temp_trigger triggers[TEMP_TRIGGERS] = {
+#if CONFIG_TEMP_TRIGGER_ON_CHANGE
+	{ .condition = TRIGGER_CHANGED },
+#else
+	{ .condition = TRIGGER_FIXED_INTERVAL, .interval_ms = CONFIG_TEMP_NOTIFY_PERIOD_MS },
+#endif
+};
+static uint8_t trigger_logic;
+static int64_t fired_us[TEMP_TRIGGERS];
+
+static int32_t last_sent;
+static bool sent_valid;
+static int32_t win_low = WINDOW_MIN_CENTI;
+static int32_t win_high = WINDOW_MAX_CENTI;
+
+static uint32_t checks;
+static uint32_t sent;
+
+static bool changed(int32_t centi)
+{
+	return !sent_valid || abs(centi - last_sent) >= CONFIG_TEMP_TRIGGER_DELTA_CENTI;
+}
+
+static bool is_value_condition(uint8_t condition)
+{
+	return condition >= TRIGGER_LT && condition <= TRIGGER_NE;
+}
+
+static bool value_holds(const struct temp_trigger *t, int32_t centi)
+{
+	switch (t->condition) {
+	case TRIGGER_LT:
+		return centi < t->centi;
+	case TRIGGER_LE:
+		return centi <= t->centi;
+	case TRIGGER_GT:
+		return centi > t->centi;
+	case TRIGGER_GE:
+		return centi >= t->centi;
+	case TRIGGER_EQ:
+		return centi == t->centi;
+	case TRIGGER_NE:
+		return centi != t->centi;
+	default:
+		return false;
+	}
+}
+
+static bool trigger_holds(int idx, int32_t centi, int64_t now_us)
+{
+	const struct temp_trigger *t = &triggers[idx];
+	bool due = now_us - fired_us[idx] + TICK_SLACK_US >= t->interval_ms * 1000LL;
+
+	switch (t->condition) {
+	case TRIGGER_FIXED_INTERVAL:
+		return due;
+	case TRIGGER_MIN_INTERVAL:
+		return due && changed(centi);
+	case TRIGGER_CHANGED:
+		return changed(centi);
+	default:
+		return value_holds(t, centi);
+	}
+}
+
+static bool triggers_hold(int32_t centi, int64_t now_us)
+{
+	bool active = false;
+	bool any = false;
+	bool all = true;
+
+	for (int i = 0; i < TEMP_TRIGGERS; i++) {
+		bool holds;
+
+		if (triggers[i].condition == TRIGGER_INACTIVE) {
+			continue;
+		}
+
+		holds = trigger_holds(i, centi, now_us);
+		active = true;
+		any |= holds;
+		all &= holds;
+	}
+
+	return active && (trigger_logic ? any : all);
+}
+
+/* Narrow the hardware thresholds around the current value to where a
+ * trigger could change its mind: the boundary of a value trigger, and a
+ * delta for a change trigger or a value trigger that holds now. The
+ * window follows the filtered value, which the triggers are checked
+ * against, while the sensor compares raw readings; see trigger_event()
+ * for a raw reading the filter has not caught up with yet. Returns
+ * whether the window moved.
+ */
+static bool window_update(int32_t centi)
+{
+	int32_t low = WINDOW_MIN_CENTI;
+	int32_t high = WINDOW_MAX_CENTI;
+
+	for (int i = 0; i < TEMP_TRIGGERS; i++) {
+		const struct temp_trigger *t = &triggers[i];
+
+		if (is_value_condition(t->condition)) {
+			if (centi < t->centi) {
+				high = MIN(high, t->centi);
+			} else {
+				low = MAX(low, t->centi);
+			}
+			if (!value_holds(t, centi)) {
+				continue;
+			}
+		} else if (t->condition != TRIGGER_CHANGED) {
+			continue;
+		}
+
+		low = MAX(low, centi - CONFIG_TEMP_TRIGGER_DELTA_CENTI);
+		high = MIN(high, centi + CONFIG_TEMP_TRIGGER_DELTA_CENTI);
+	}
+
+	if (low == win_low && high == win_high) {
+		return false;
+	}
+
+	if (temp_set_window(low, high) != ESP_OK) {
+		return false;
+	}
+
+	win_low = low;
+	win_high = high;
+	return true;
+}
+
+static void send(int32_t centi, int64_t now_us)
+{
+	struct gatt_svr_mbuf_stats mbufs;
+	uint8_t temp[TEMP_VALUE_MAX_LEN];
+	uint16_t len;
+	int peers;
+
+	len = temp_encode(temp);
+	peers = gatt_svr_notify(temp_handle, temp, len);
+	trace(TRACE_NOTIFY, BLE_HS_CONN_HANDLE_NONE, temp_handle, 0, peers);
+	if (peers == 0) {
+		return;
+	}
+
+	last_sent = centi;
+	sent_valid = true;
+	for (int i = 0; i < TEMP_TRIGGERS; i++) {
+		fired_us[i] = now_us;
+	}
+	sent++;
+
+	if (!HOT_LOG_ENABLED(ESP_LOG_INFO)) {
+		return;
+	}
+
+	gatt_svr_mbuf_stats_get(&mbufs);
+	ESP_LOGI(TAG, "Temperature: %.02f C to %d peers (sent %lu of %lu checks; "
+			 "mbufs low %u reserved %d msys, %lu dropped)",
+			 centi / 100.0f, peers,
+			 (unsigned long)sent, (unsigned long)checks,
+			 mbufs.reserved_min_free, mbufs.msys_min_free,
+			 (unsigned long)(mbufs.reserved_failures + mbufs.msys_failures));
+}
+
+/* First value for the peers that just subscribed, outside the triggers. */
+static void send_first(void)
+{
+	uint8_t temp[TEMP_VALUE_MAX_LEN];
+	uint16_t len;
+
+	len = temp_encode(temp);
+	for (int i = 0; i < first_count; i++) {
+		gatt_svr_notify_conn(first_conn[i], temp_handle, temp, len);
+	}
+	first_count = 0;
+}
+
+/* Host task. */
+static void trigger_event(struct ble_npl_event *ev)
+{
+	int reason = (intptr_t)ble_npl_event_get_arg(ev);
+	int64_t now_us = esp_timer_get_time();
+	bool acted = false;
+	int32_t centi;
+
+	temp_latest(&centi, NULL);
+
+	if (reason == EV_SETTLE) {
+		atomic_store(&threshold_masked, false);
+	}
+
+	if (reason == EV_SUBSCRIBE) {
+		send_first();
+	} else if (gatt_svr_subscribers(temp_handle) > 0) {
+		checks++;
+		if (triggers_hold(centi, now_us)) {
+			send(centi, now_us);
+			acted = true;
+		}
+	}
+
+	if (window_update(centi)) {
+		acted = true;
+	}
+
+	/* A raw reading left the window but the filtered value has not moved:
+	 * the sensor would interrupt again on every reading until the filter
+	 * follows, each time for nothing. Look again once it had the time to.
+	 */
+	if (reason == EV_THRESHOLD && !acted) {
+		atomic_store(&threshold_masked, true);
+		esp_timer_start_once(settle_timer, FILTER_SETTLE_MS * 1000ULL);
+	}
+}
+
+/* esp_timer task and threshold interrupt: hand over to the host. */
+static void tick_timer_cb(void *arg)
+{
+	ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &tick_ev);
+}
+
+static void threshold_cb(void)
+{
+	if (!atomic_load(&threshold_masked)) {
+		ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &threshold_ev);
+	}
+}
+
+static void settle_timer_cb(void *arg)
+{
+	ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &settle_ev);
+}
+
+/* Tick at the shortest interval trigger; value triggers need no tick. */
+static void tick_update(void)
+{
+	uint32_t period_ms = 0;
+
+	for (int i = 0; i < TEMP_TRIGGERS; i++) {
+		const struct temp_trigger *t = &triggers[i];
+
+		if (t->condition == TRIGGER_FIXED_INTERVAL ||
+			t->condition == TRIGGER_MIN_INTERVAL) {
+			if (period_ms == 0 || t->interval_ms < period_ms) {
+				period_ms = t->interval_ms;
+			}
+		}
+	}
+
+	esp_timer_stop(tick_timer);
+	if (period_ms != 0 && gatt_svr_subscribers(temp_handle) > 0) {
+		ESP_ERROR_CHECK(esp_timer_start_periodic(tick_timer, period_ms * 1000ULL));
+	}
+}
+
+int telemetry_init(void)
+{
+	const esp_timer_create_args_t args = {
+		.callback = tick_timer_cb,
+		.name = "temp_notify",
+	};
+	const esp_timer_create_args_t settle_args = {
+		.callback = settle_timer_cb,
+		.name = "temp_settle",
+	};
+	int rc;
+
+	ble_npl_event_init(&subscribe_ev, trigger_event, (void *)(intptr_t)EV_SUBSCRIBE);
+	ble_npl_event_init(&tick_ev, trigger_event, (void *)(intptr_t)EV_TICK);
+	ble_npl_event_init(&threshold_ev, trigger_event, (void *)(intptr_t)EV_THRESHOLD);
+	ble_npl_event_init(&settle_ev, trigger_event, (void *)(intptr_t)EV_SETTLE);
+
+	rc = esp_timer_create(&settle_args, &settle_timer);
+	if (rc != 0) {
+		return rc;
+	}
+
+	temp_set_threshold_handler(threshold_cb);
+
+	return esp_timer_create(&args, &tick_timer);
+}
+
+void telemetry_start(uint16_t conn_handle)
+{
+	/* The GAP callback runs on the host task too, so the list needs no
+	 * lock. A peer that resubscribes before its first value went out is
+	 * already on it.
+	 */
+	for (int i = 0; i < first_count; i++) {
+		if (first_conn[i] == conn_handle) {
+			return;
+		}
+	}
+	if (first_count < CONFIG_BT_NIMBLE_MAX_CONNECTIONS) {
+		first_conn[first_count++] = conn_handle;
+	}
+
+	/* The first peer restarts the intervals. The first value goes out
+	 * once the GAP callback has returned.
+	 */
+	if (gatt_svr_subscribers(temp_handle) == 1) {
+		sent_valid = false;
+		tick_update();
+	}
+	ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &subscribe_ev);
+}
+
+void telemetry_stop(void)
+{
+	if (gatt_svr_subscribers(temp_handle) == 0) {
+		esp_timer_stop(tick_timer);
+	}
+}
+
+void telemetry_trigger_get(int idx, struct temp_trigger *trigger)
+{
+	*trigger = triggers[idx];
+}
+
+int telemetry_trigger_set(int idx, const struct temp_trigger *trigger)
+{
+	if (trigger->condition > TRIGGER_NE) {
+		return ESS_ERR_CONDITION_NOT_SUPPORTED;
+	}
+
+	if ((trigger->condition == TRIGGER_FIXED_INTERVAL ||
+		 trigger->condition == TRIGGER_MIN_INTERVAL) && trigger->interval_ms == 0) {
+		return ESS_ERR_WRITE_REJECTED;
+	}
+
+	triggers[idx] = *trigger;
+	tick_update();
+
+	/* Re-arm the thresholds for the new condition, unmasked. */
+	ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &settle_ev);
+
+	return 0;
+}
+
+uint8_t telemetry_trigger_logic_get(void)
+{
+	return trigger_logic;
+}
+
+void telemetry_trigger_logic_set(uint8_t logic)
+{
+	trigger_logic = logic;
+}
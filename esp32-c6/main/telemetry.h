@@ -0,0 +1,56 @@
+/*
+ * telemetry.h
+ *
+ *  Temperature notifications, sent from the NimBLE host task when the
+ *  ESS Trigger Settings of the Temperature characteristic say so.
+ */
+
+#ifndef MAIN_TELEMETRY_H_
+#define MAIN_TELEMETRY_H_
+
+#include <stdint.h>
+
+/* Trigger Setting descriptors on the Temperature characteristic. */
+#define TEMP_TRIGGERS 2
+
+/* ESS Trigger Setting conditions. */
+#define TRIGGER_INACTIVE        0x00
+#define TRIGGER_FIXED_INTERVAL  0x01 /* operand: seconds */
+#define TRIGGER_MIN_INTERVAL    0x02 /* operand: seconds */
+#define TRIGGER_CHANGED         0x03
+#define TRIGGER_LT              0x04 /* operand: value */
+#define TRIGGER_LE              0x05
+#define TRIGGER_GT              0x06
+#define TRIGGER_GE              0x07
+#define TRIGGER_EQ              0x08
+#define TRIGGER_NE              0x09
+
+/* ESS application error codes. */
+#define ESS_ERR_WRITE_REJECTED          0x80
+#define ESS_ERR_CONDITION_NOT_SUPPORTED 0x81
+
+struct temp_trigger {
+	uint8_t condition;
+	uint32_t interval_ms;  /* FIXED_INTERVAL, MIN_INTERVAL */
+	int32_t centi;         /* LT ... NE, 0.01 degree units */
+};
+
+int telemetry_init(void);
+
+/* conn_handle subscribed to the temperature: send it a first value right
+ * away and keep the triggers running. Returns immediately.
+ */
+void telemetry_start(uint16_t conn_handle);
+
+/* A peer unsubscribed or disconnected; stop once nobody is left. */
+void telemetry_stop(void);
+
+/* Trigger Setting idx. set() returns 0 or an ATT error. */
+void telemetry_trigger_get(int idx, struct temp_trigger *trigger);
+int telemetry_trigger_set(int idx, const struct temp_trigger *trigger);
+
+/* ES Configuration: 0 = notify when all triggers hold, 1 = any. */
+uint8_t telemetry_trigger_logic_get(void);
+void telemetry_trigger_logic_set(uint8_t logic);
+
+#endif /* MAIN_TELEMETRY_H_ */
@@ -4,22 +4,168 @@
  *  Created on: 25-Jan-2024
  *      Author: sahil
  */
+#include <stdatomic.h>
+
 #include "host/ble_hs.h"
 #include "driver/temperature_sensor.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
 #include "os/endian.h"
 #include "temp.h"
 
 #define TAG "Nimble_ble_PRPH-temp"
 temperature_sensor_handle_t temp_sensor = NULL;
 
-float read_temp = 0;
+#define FILTER_TAPS CONFIG_TEMP_FILTER_TAPS
+
+static esp_timer_handle_t sample_timer;
+
+/* Latest filtered value, written by the sampler only and read from any
+ * task without a lock: the sequence is odd while a write is in progress,
+ * and a reader retries if it changed under it.
+ */
+static atomic_uint sample_seq;
+static int32_t sample_centi;
+static int64_t sample_at_us;
+
+/* Raw samples in 0.01 degree units, oldest overwritten first. */
+static int32_t ring[FILTER_TAPS];
+static uint32_t ring_head;
+static uint32_t ring_count;
 
+#if CONFIG_TEMP_FILTER_MA
+static int32_t ma_sum;
+#elif CONFIG_TEMP_FILTER_IIR
+static int32_t iir_acc;  /* output << CONFIG_TEMP_FILTER_IIR_SHIFT */
+#endif
+
+static struct temp_filter_stats filter_stats;
+#if CONFIG_TEMP_FILTER_REPORT_SEC
+static uint32_t report_count;
+#endif
+
+static void (*threshold_handler)(void);
+
+/* Interrupt context. */
 static bool temp_sensor_monitor_cbs(temperature_sensor_handle_t tsens, const temperature_sensor_threshold_event_data_t *edata, void *user_data)
 {
-    ESP_DRAM_LOGI("tsens", "Temperature value is higher or lower than threshold, value is %d\n...\n\n", edata->celsius_value);
+    if (threshold_handler != NULL) {
+        threshold_handler();
+    }
     return false;
 }
 
+static void sample_store(int32_t centi)
+{
+	unsigned int seq = atomic_load_explicit(&sample_seq, memory_order_relaxed);
+
+	atomic_store_explicit(&sample_seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	sample_centi = centi;
+	sample_at_us = esp_timer_get_time();
+
+	atomic_store_explicit(&sample_seq, seq + 2, memory_order_release);
+}
+
+/* Push a raw sample into the ring and return the filtered value. Integer
+ * arithmetic only.
+ */
+static int32_t filter_push(int32_t raw)
+{
+#if CONFIG_TEMP_FILTER_MA
+	/* Running sum; the oldest sample leaves as the new one enters. */
+	if (ring_count == FILTER_TAPS) {
+		ma_sum -= ring[ring_head];
+	}
+	ma_sum += raw;
+#endif
+
+	ring[ring_head] = raw;
+	ring_head = (ring_head + 1) % FILTER_TAPS;
+	if (ring_count < FILTER_TAPS) {
+		ring_count++;
+	}
+
+#if CONFIG_TEMP_FILTER_MA
+	return ma_sum / (int32_t)ring_count;
+#elif CONFIG_TEMP_FILTER_MEDIAN
+	int32_t sorted[FILTER_TAPS];
+
+	/* Insertion sort into a copy; N is small. */
+	for (uint32_t i = 0; i < ring_count; i++) {
+		int32_t v = ring[i];
+		uint32_t j = i;
+
+		while (j > 0 && sorted[j - 1] > v) {
+			sorted[j] = sorted[j - 1];
+			j--;
+		}
+		sorted[j] = v;
+	}
+	return sorted[ring_count / 2];
+#else
+	/* y += (x - y) / 2^shift, seeded with the first sample. */
+	if (ring_count == 1) {
+		iir_acc = raw << CONFIG_TEMP_FILTER_IIR_SHIFT;
+	} else {
+		iir_acc += raw - (iir_acc >> CONFIG_TEMP_FILTER_IIR_SHIFT);
+	}
+	return iir_acc >> CONFIG_TEMP_FILTER_IIR_SHIFT;
+#endif
+}
+
+#if CONFIG_TEMP_FILTER_REPORT_SEC
+static void filter_report(void)
+{
+	if (filter_stats.samples == 0) {
+		return;
+	}
+
+	ESP_LOGI(TAG, "Sampling: %lu samples, read avg %lu cycles, filter avg %lu max %lu cycles",
+			 (unsigned long)filter_stats.samples,
+			 (unsigned long)(filter_stats.read_cycles / filter_stats.samples),
+			 (unsigned long)(filter_stats.filter_cycles / filter_stats.samples),
+			 (unsigned long)filter_stats.filter_max_cycles);
+}
+#endif
+
+/* esp_timer task. The sensor stays enabled, so this is a register read. */
+static void sample_timer_cb(void *arg)
+{
+	uint32_t start = esp_cpu_get_cycle_count();
+	uint32_t read_end;
+	uint32_t filter_cycles;
+	float celsius;
+	int32_t centi;
+
+	if (temperature_sensor_get_celsius(temp_sensor, &celsius) != ESP_OK) {
+		return;
+	}
+	read_end = esp_cpu_get_cycle_count();
+
+	/* The driver only hands out floats; convert once, on the way in. */
+	centi = (int32_t)(celsius * 100.0f);
+	sample_store(filter_push(centi));
+
+	filter_cycles = esp_cpu_get_cycle_count() - read_end;
+
+	filter_stats.samples++;
+	filter_stats.read_cycles += read_end - start;
+	filter_stats.filter_cycles += filter_cycles;
+	if (filter_cycles > filter_stats.filter_max_cycles) {
+		filter_stats.filter_max_cycles = filter_cycles;
+	}
+
+#if CONFIG_TEMP_FILTER_REPORT_SEC
+	if (++report_count * CONFIG_TEMP_SAMPLE_PERIOD_MS >=
+		CONFIG_TEMP_FILTER_REPORT_SEC * 1000) {
+		report_count = 0;
+		filter_report();
+	}
+#endif
+}
+
 int temp_sensor_init()
 {
 	ESP_LOGI(TAG, "Install temperature sensor, expected temp ranger range: 10~50 ℃");
@@ -42,25 +188,93 @@ int temp_sensor_init()
 	ESP_LOGI(TAG, "Enable temperature sensor");
 	ESP_ERROR_CHECK(temperature_sensor_enable(temp_sensor));
 
-	ESP_LOGI(TAG, "Read temperature");
-	int cnt = 3;
-	float read_temp;
+	/* First sample now, so readers never see an empty cell. */
+	sample_timer_cb(NULL);
+	ESP_LOGI(TAG, "Temperature value %.02f ℃", read_temperature());
 
-	while (cnt--) {
-		ESP_ERROR_CHECK(temperature_sensor_get_celsius(temp_sensor, &read_temp));
-		ESP_LOGI(TAG, "Temperature value %.02f ℃", read_temp);
-		vTaskDelay(pdMS_TO_TICKS(1000));
-	}
-	temperature_sensor_disable(temp_sensor);
+	const esp_timer_create_args_t args = {
+		.callback = sample_timer_cb,
+		.name = "temp_sampler",
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&args, &sample_timer));
+	ESP_ERROR_CHECK(esp_timer_start_periodic(sample_timer,
+											 CONFIG_TEMP_SAMPLE_PERIOD_MS * 1000ULL));
 	return 0;
 }
 
+void temp_latest(int32_t *centi, int64_t *at_us)
+{
+	unsigned int seq;
+	int32_t c;
+	int64_t at;
+
+	do {
+		seq = atomic_load_explicit(&sample_seq, memory_order_acquire);
+		c = sample_centi;
+		at = sample_at_us;
+		atomic_thread_fence(memory_order_acquire);
+	} while ((seq & 1) ||
+			 seq != atomic_load_explicit(&sample_seq, memory_order_relaxed));
+
+	*centi = c;
+	if (at_us != NULL) {
+		*at_us = at;
+	}
+}
+
 float read_temperature()
 {
-	ESP_ERROR_CHECK(temperature_sensor_enable(temp_sensor));
-	ESP_ERROR_CHECK(temperature_sensor_get_celsius(temp_sensor, &read_temp));
-	ESP_LOGI(TAG, "Temperature value %.02f celsius", read_temp);
+	int32_t centi;
+
+	temp_latest(&centi, NULL);
+	return centi / 100.0f;
+}
+
+void temp_set_threshold_handler(void (*handler)(void))
+{
+	threshold_handler = handler;
+}
+
+esp_err_t temp_set_window(int32_t low_centi, int32_t high_centi)
+{
+	temperature_sensor_abs_threshold_config_t threshold_cfg = {
+		.high_threshold = high_centi / 100.0f,
+		.low_threshold = low_centi / 100.0f,
+	};
+	esp_err_t err;
+
+	/* The thresholds only take while the sensor is stopped; the sampler
+	 * skips a reading that lands in between.
+	 */
 	temperature_sensor_disable(temp_sensor);
-	return read_temp;
+	err = temperature_sensor_set_absolute_threshold(temp_sensor, &threshold_cfg);
+	ESP_ERROR_CHECK(temperature_sensor_enable(temp_sensor));
+
+	return err;
 }
 
+uint16_t temp_encode(uint8_t *buf)
+{
+	int32_t centi;
+
+	temp_latest(&centi, NULL);
+
+#if CONFIG_TEMP_LEGACY_UINT8
+	buf[0] = (uint8_t)(centi / 100);
+	return 1;
+#else
+	/* 0x8000 means "value not known"; saturate short of it. */
+	if (centi > INT16_MAX) {
+		centi = INT16_MAX;
+	} else if (centi < -INT16_MAX) {
+		centi = -INT16_MAX;
+	}
+	put_le16(buf, (uint16_t)(int16_t)centi);
+	return 2;
+#endif
+}
+
+void temp_filter_stats_get(struct temp_filter_stats *stats)
+{
+	*stats = filter_stats;
+}
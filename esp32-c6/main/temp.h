@@ -13,10 +13,55 @@
 #define BLE_SERVICE_UUID 0x181A // Environmental Sensing Service
 #define BLE_TEMP_CHAR_UUID 0x2A6E // Temperature Characteristic
 #define BLE_TEMP_DESC_UUID 0x2902 // Client Characteristic Configuration Descriptor
+#define BLE_ES_CONFIG_DESC_UUID 0x290B // Environmental Sensing Configuration
+#define BLE_ES_MEASUREMENT_DESC_UUID 0x290C // Environmental Sensing Measurement
+#define BLE_ES_TRIGGER_DESC_UUID 0x290D // Environmental Sensing Trigger Setting
+
+/* Largest encoded Temperature value, see temp_encode(). */
+#define TEMP_VALUE_MAX_LEN 2
 
 extern temperature_sensor_handle_t temp_sensor;
 
+/* CPU cost of the sampling pipeline, in CPU cycles. */
+struct temp_filter_stats {
+	uint32_t samples;
+	uint64_t read_cycles;    /* driver reads, total */
+	uint64_t filter_cycles;  /* filter and publish, total */
+	uint32_t filter_max_cycles;
+};
+
+/* Install and enable the sensor and start sampling it every
+ * CONFIG_TEMP_SAMPLE_PERIOD_MS in the background, through the filter
+ * selected in menuconfig.
+ */
 int temp_sensor_init(void);
+
+/* Latest filtered value in 0.01 degree units and the esp_timer time it
+ * was taken at (at_us may be NULL). Lock-free and never touches the
+ * driver, so it is cheap enough for GATT access callbacks.
+ */
+void temp_latest(int32_t *centi, int64_t *at_us);
+
+/* Latest filtered value in degrees Celsius. */
 float read_temperature();
 
+/* Called from the sensor interrupt when a reading leaves the window set
+ * by temp_set_window().
+ */
+void temp_set_threshold_handler(void (*handler)(void));
+
+/* Program the hardware thresholds, in 0.01 degree units (the hardware
+ * resolves whole degrees).
+ */
+esp_err_t temp_set_window(int32_t low_centi, int32_t high_centi);
+
+/* Encode the latest value as the Temperature characteristic carries it:
+ * sint16 in 0.01 degree units, little endian, or a single truncated byte
+ * with CONFIG_TEMP_LEGACY_UINT8 for hubs that predate the change. Returns
+ * the length, at most TEMP_VALUE_MAX_LEN.
+ */
+uint16_t temp_encode(uint8_t *buf);
+
+void temp_filter_stats_get(struct temp_filter_stats *stats);
+
 #endif /* MAIN_TEMP_H_ */
@@ -0,0 +1,111 @@
+/*
+ * trace.c
+ *
+ *  Binary trace ring. Records are written from the NimBLE host task, which
+ *  runs every GATT callback and GAP event; the slot index is still taken
+ *  atomically so a record from another task cannot land in the same slot.
+ *  A reader racing a writer may see one torn record, which is fine for a
+ *  debug dump.
+ */
+#include <stdatomic.h>
+#include <string.h>
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "trace.h"
+
+#define TAG "Nimble_ble_PRPH-trace"
+
+_Static_assert((CONFIG_TRACE_RING_SIZE & (CONFIG_TRACE_RING_SIZE - 1)) == 0,
+			   "TRACE_RING_SIZE must be a power of two");
+
+static struct trace_rec ring[CONFIG_TRACE_RING_SIZE];
+static atomic_uint ring_head;
+static struct trace_access_stats access_stats;
+
+static const char *const trace_names[] = {
+	[TRACE_ACCESS] = "access",
+	[TRACE_SUBSCRIBE] = "subscribe",
+	[TRACE_NOTIFY] = "notify",
+	[TRACE_NOTIFY_TX] = "notify_tx",
+	[TRACE_LED] = "led",
+};
+
+void trace(uint8_t id, uint16_t conn_handle, uint16_t handle, uint8_t op, uint16_t arg)
+{
+	unsigned int i = atomic_fetch_add_explicit(&ring_head, 1, memory_order_relaxed);
+	struct trace_rec *rec = &ring[i & (CONFIG_TRACE_RING_SIZE - 1)];
+
+	rec->ts_us = (uint32_t)esp_timer_get_time();
+	rec->conn_handle = conn_handle;
+	rec->handle = handle;
+	rec->id = id;
+	rec->op = op;
+	rec->arg = arg;
+}
+
+void trace_access(uint16_t conn_handle, uint16_t handle, uint8_t op, uint32_t start_cycles)
+{
+	uint32_t cycles = esp_cpu_get_cycle_count() - start_cycles;
+	uint32_t us = cycles / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+
+	access_stats.count++;
+	access_stats.total_cycles += cycles;
+	if (cycles > access_stats.max_cycles) {
+		access_stats.max_cycles = cycles;
+	}
+
+	trace(TRACE_ACCESS, conn_handle, handle, op, us > UINT16_MAX ? UINT16_MAX : us);
+}
+
+size_t trace_count(void)
+{
+	unsigned int head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+
+	return head < CONFIG_TRACE_RING_SIZE ? head : CONFIG_TRACE_RING_SIZE;
+}
+
+void trace_get(size_t i, struct trace_rec *rec)
+{
+	unsigned int head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+	unsigned int n = head < CONFIG_TRACE_RING_SIZE ? head : CONFIG_TRACE_RING_SIZE;
+
+	*rec = ring[(head - n + i) & (CONFIG_TRACE_RING_SIZE - 1)];
+}
+
+void trace_access_stats_get(struct trace_access_stats *stats)
+{
+	*stats = access_stats;
+}
+
+void trace_clear(void)
+{
+	atomic_store_explicit(&ring_head, 0, memory_order_relaxed);
+	memset(&access_stats, 0, sizeof(access_stats));
+}
+
+void trace_dump(void)
+{
+	struct trace_rec rec;
+	size_t n = trace_count();
+
+	for (size_t i = 0; i < n; i++) {
+		trace_get(i, &rec);
+		ESP_LOGI(TAG, "%10lu %-9s conn=%u handle=%u op=%u arg=%u",
+				 (unsigned long)rec.ts_us,
+				 rec.id < sizeof(trace_names) / sizeof(trace_names[0]) ?
+				 trace_names[rec.id] : "?",
+				 rec.conn_handle, rec.handle, rec.op, rec.arg);
+	}
+
+	if (access_stats.count) {
+		ESP_LOGI(TAG, "GATT access: %lu callbacks, avg %lu max %lu cycles",
+				 (unsigned long)access_stats.count,
+				 (unsigned long)(access_stats.total_cycles / access_stats.count),
+				 (unsigned long)access_stats.max_cycles);
+	}
+
+	trace_clear();
+}
@@ -0,0 +1,71 @@
+/*
+ * trace.h
+ *
+ *  Hot path logging. Per-access logs go through HOT_LOG, which compiles
+ *  away below CONFIG_HOT_LOG_LEVEL, and the events themselves go into a
+ *  small binary ring that costs a few stores and is dumped on demand.
+ */
+
+#ifndef MAIN_TRACE_H_
+#define MAIN_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_log.h"
+
+#define CUSTOM_TRACE_CHAR_UUID 0x5679 // Trace ring, custom service
+
+#define HOT_LOG_ENABLED(level) (CONFIG_HOT_LOG_LEVEL >= (level))
+
+#define HOT_LOG(level, tag, format, ...) do {				\
+	if (HOT_LOG_ENABLED(level)) {					\
+		ESP_LOG_LEVEL(level, tag, format, ##__VA_ARGS__);	\
+	}								\
+} while (0)
+
+#define HOT_LOGI(tag, format, ...) HOT_LOG(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define HOT_LOGD(tag, format, ...) HOT_LOG(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+enum trace_id {
+	TRACE_ACCESS,     /* op: access op, arg: callback time in us */
+	TRACE_SUBSCRIBE,  /* arg: CCCD flags */
+	TRACE_NOTIFY,     /* arg: peers the value went to */
+	TRACE_NOTIFY_TX,  /* op: indication, arg: status */
+	TRACE_LED,        /* arg: LED on */
+};
+
+struct trace_rec {
+	uint32_t ts_us;   /* esp_timer time, wraps after 71 minutes */
+	uint16_t conn_handle;
+	uint16_t handle;
+	uint8_t id;
+	uint8_t op;
+	uint16_t arg;
+};
+
+/* GATT access callbacks, in CPU cycles. */
+struct trace_access_stats {
+	uint32_t count;
+	uint64_t total_cycles;
+	uint32_t max_cycles;
+};
+
+void trace(uint8_t id, uint16_t conn_handle, uint16_t handle, uint8_t op, uint16_t arg);
+
+/* Account for one access callback that started at start_cycles and trace
+ * it.
+ */
+void trace_access(uint16_t conn_handle, uint16_t handle, uint8_t op, uint32_t start_cycles);
+
+/* Records in the ring, and record i of them, 0 being the oldest. */
+size_t trace_count(void);
+void trace_get(size_t i, struct trace_rec *rec);
+
+void trace_access_stats_get(struct trace_access_stats *stats);
+
+/* Log the ring and the access statistics, then clear the ring. */
+void trace_dump(void);
+void trace_clear(void);
+
+#endif /* MAIN_TRACE_H_ */
@@ -0,0 +1,245 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Data path benchmark. The stack calls in relay_bt.h are replaced by the
+ * mocks below, which accept every PDU and let the benchmark complete it,
+ * so the relay logic runs against fake nodes and a fake hub without any
+ * peer. Build with overlay-bench.conf, or run tests/bench on native_sim.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/timing/timing.h>
+
+#include "bench.h"
+#include "link.h"
+#include "profile.h"
+#include "relay_bt.h"
+#include "upstream.h"
+
+/* A relayed value goes out twice: as a relay frame and on the mirrored
+ * characteristic.
+ */
+#define NOTIFY_PDUS  2
+#define PDU_TIMEOUT  K_MSEC(100)
+#define MOCK_PENDING 8
+
+/* Connections are only compared by address on the data path. */
+static uint8_t fake_conns[1 + CONFIG_RELAY_MAX_NODES];
+#define FAKE_HUB       ((struct bt_conn *)&fake_conns[0])
+#define FAKE_NODE(i)   ((struct bt_conn *)&fake_conns[1 + (i)])
+
+static K_SEM_DEFINE(pdu_sem, 0, MOCK_PENDING);
+static timing_t last_pdu;
+
+static struct {
+	struct bt_conn *conn;
+	bt_gatt_complete_func_t notify_func;
+	void *user_data;
+	struct bt_gatt_write_params *write;
+} pending[MOCK_PENDING];
+static size_t pending_count;
+static struct k_spinlock pending_lock;
+
+struct bt_conn *relay_bt_conn_ref(struct bt_conn *conn)
+{
+	return conn;
+}
+
+void relay_bt_conn_unref(struct bt_conn *conn)
+{
+}
+
+bool relay_bt_is_subscribed(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			    uint16_t ccc_type)
+{
+	return conn == FAKE_HUB;
+}
+
+static int mock_pdu(struct bt_conn *conn, bt_gatt_complete_func_t func, void *user_data,
+		    struct bt_gatt_write_params *write)
+{
+	k_spinlock_key_t key = k_spin_lock(&pending_lock);
+
+	if (pending_count >= ARRAY_SIZE(pending)) {
+		k_spin_unlock(&pending_lock, key);
+		return -ENOMEM;
+	}
+
+	pending[pending_count].conn = conn;
+	pending[pending_count].notify_func = func;
+	pending[pending_count].user_data = user_data;
+	pending[pending_count].write = write;
+	pending_count++;
+
+	k_spin_unlock(&pending_lock, key);
+
+	last_pdu = timing_counter_get();
+	k_sem_give(&pdu_sem);
+
+	return 0;
+}
+
+int relay_bt_notify(struct bt_conn *conn, struct bt_gatt_notify_params *params)
+{
+	return mock_pdu(conn, params->func, params->user_data, NULL);
+}
+
+int relay_bt_write(struct bt_conn *conn, struct bt_gatt_write_params *params)
+{
+	return mock_pdu(conn, NULL, NULL, params);
+}
+
+int relay_bt_write_cmd(struct bt_conn *conn, uint16_t handle, const void *data, uint16_t len)
+{
+	return 0;
+}
+
+/* The fake nodes come with their handles; nothing is discovered. */
+int relay_bt_discover(struct bt_conn *conn, struct bt_gatt_discover_params *params)
+{
+	return -ENOTSUP;
+}
+
+int relay_bt_subscribe(struct bt_conn *conn, struct bt_gatt_subscribe_params *params)
+{
+	return -ENOTSUP;
+}
+
+int relay_bt_resubscribe(struct bt_conn *conn, struct bt_gatt_subscribe_params *params)
+{
+	return -ENOTSUP;
+}
+
+int relay_bt_read(struct bt_conn *conn, struct bt_gatt_read_params *params)
+{
+	return -ENOTSUP;
+}
+
+/* Complete everything the mocks accepted, in order, as the stack would
+ * once the peers acknowledged. Completions may queue more PDUs, which go
+ * to the next batch.
+ */
+static void complete_pending(void)
+{
+	struct bt_conn *conn[MOCK_PENDING];
+	bt_gatt_complete_func_t func[MOCK_PENDING];
+	void *user_data[MOCK_PENDING];
+	struct bt_gatt_write_params *write[MOCK_PENDING];
+	k_spinlock_key_t key = k_spin_lock(&pending_lock);
+	size_t count = pending_count;
+
+	for (size_t i = 0; i < count; i++) {
+		conn[i] = pending[i].conn;
+		func[i] = pending[i].notify_func;
+		user_data[i] = pending[i].user_data;
+		write[i] = pending[i].write;
+	}
+	pending_count = 0;
+
+	k_spin_unlock(&pending_lock, key);
+
+	for (size_t i = 0; i < count; i++) {
+		if (write[i]) {
+			write[i]->func(conn[i], 0, write[i]);
+		} else if (func[i]) {
+			func[i](conn[i], user_data[i]);
+		}
+	}
+}
+
+static void run(struct bench_result *res, int pdus, void (*op)(uint8_t v))
+{
+	for (uint32_t n = 0; n < CONFIG_RELAY_BENCH_ITERATIONS; n++) {
+		timing_t start, called;
+		uint64_t total;
+		int i;
+
+		k_sem_reset(&pdu_sem);
+
+		start = timing_counter_get();
+		op(n);
+		called = timing_counter_get();
+
+		for (i = 0; i < pdus; i++) {
+			if (k_sem_take(&pdu_sem, PDU_TIMEOUT)) {
+				break;
+			}
+		}
+
+		if (i < pdus) {
+			res->timeouts++;
+		} else {
+			total = timing_cycles_get(&start, &last_pdu);
+			res->count++;
+			res->call_cyc += timing_cycles_get(&start, &called);
+			res->total_cyc += total;
+			res->max_cyc = MAX(res->max_cyc, total);
+		}
+
+		complete_pending();
+	}
+}
+
+static void relay_op(uint8_t v)
+{
+	uint8_t temp[sizeof(int16_t)];
+
+	sys_put_le16(v * 100, temp);
+	profile_relay(&links[0], LINK_CHR_TEMP, temp, sizeof(temp));
+}
+
+static void write_op(uint8_t v)
+{
+	profile_route_write(LINK_CHR_LED, &v, sizeof(v));
+}
+
+void bench_report(const struct bench_result *res)
+{
+	uint32_t n = MAX(res->count, 1);
+
+	printk("[BENCH] %s: %u runs, %u timeouts, call %u cyc, total %u cyc (%u ns), max %u cyc\n",
+	       res->name, res->count, res->timeouts, (uint32_t)(res->call_cyc / n),
+	       (uint32_t)(res->total_cyc / n),
+	       (uint32_t)timing_cycles_to_ns(res->total_cyc / n), (uint32_t)res->max_cyc);
+}
+
+void bench_run(struct bench_result *notify, struct bench_result *write)
+{
+	timing_init();
+	timing_start();
+
+	for (int i = 0; i < CONFIG_RELAY_MAX_NODES; i++) {
+		struct relay_link *link = link_alloc(FAKE_NODE(i));
+
+		for (int chr = 0; chr < LINK_CHR_COUNT; chr++) {
+			link->subscribe_params[chr].value_handle = 0x10 + chr;
+		}
+	}
+
+	upstream_attach(FAKE_HUB);
+
+	run(notify, NOTIFY_PDUS, relay_op);
+	run(write, CONFIG_RELAY_MAX_NODES, write_op);
+
+	timing_stop();
+}
+
+/* tests/bench runs the benchmark from a test case instead. */
+#if !defined(CONFIG_ZTEST)
+static void bench_thread(void *p1, void *p2, void *p3)
+{
+	struct bench_result notify = { .name = "notify" };
+	struct bench_result write = { .name = "write" };
+
+	bench_run(&notify, &write);
+
+	bench_report(&notify);
+	bench_report(&write);
+	printk("[BENCH] done\n");
+}
+
+K_THREAD_DEFINE(bench_tid, 2048, bench_thread, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 1000);
+#endif
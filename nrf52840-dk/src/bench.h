@@ -0,0 +1,27 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+
+struct bench_result {
+	const char *name;
+	uint32_t count;
+	uint32_t timeouts;
+	uint64_t call_cyc;  /* in the relay entry point */
+	uint64_t total_cyc; /* until the last PDU reached the stack */
+	uint64_t max_cyc;
+};
+
+/* Relay CONFIG_RELAY_BENCH_ITERATIONS values from fake nodes to a fake hub,
+ * then route as many hub writes to the nodes, timing each. Takes the link
+ * slots and the hub slot, so it runs once per boot.
+ */
+void bench_run(struct bench_result *notify, struct bench_result *write);
+
+void bench_report(const struct bench_result *res);
+
+#endif /* BENCH_H_ */
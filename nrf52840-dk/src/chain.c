@@ -0,0 +1,228 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include "chain.h"
+#include "relay_svc.h"
+#include "resume.h"
+
+/* Sequence window per origin relay and node, shared by all links, so a
+ * frame that reaches us over two paths is only forwarded once.
+ */
+struct chain_stream {
+	uint8_t origin;
+	uint8_t node;
+	bool used;
+	uint32_t last_used;
+	struct seq_window window;
+};
+
+/* Discovery keeps pointers to these. */
+static const struct bt_uuid_128 frame_uuid = BT_UUID_INIT_128(RELAY_UUID_VAL(0x0002));
+static const struct bt_uuid_16 ccc_uuid = BT_UUID_INIT_16(BT_UUID_GATT_CCC_VAL);
+
+static struct chain_stream streams[CONFIG_RELAY_CHAIN_STREAMS];
+static uint32_t stream_clock;
+static struct chain_stats stats;
+
+static struct chain_stream *stream_get(uint8_t origin, uint8_t node)
+{
+	struct chain_stream *lru = &streams[0];
+
+	for (size_t i = 0; i < ARRAY_SIZE(streams); i++) {
+		struct chain_stream *s = &streams[i];
+
+		if (s->used && s->origin == origin && s->node == node) {
+			s->last_used = ++stream_clock;
+			return s;
+		}
+
+		if (!s->used || (lru->used && s->last_used < lru->last_used)) {
+			lru = s;
+		}
+	}
+
+	/* A recycled stream starts a new window, like a restarted sender. */
+	lru->origin = origin;
+	lru->node = node;
+	lru->used = true;
+	lru->last_used = ++stream_clock;
+	lru->window.valid = false;
+
+	return lru;
+}
+
+static void chain_rx(struct relay_link *link, const uint8_t *data, uint16_t len)
+{
+	const struct relay_frame_hdr *hdr = (const struct relay_frame_hdr *)data;
+	struct chain_stream *s;
+
+	if (len < sizeof(*hdr)) {
+		return;
+	}
+
+	if (hdr->origin == relay_origin_id()) {
+		stats.loops++;
+		return;
+	}
+
+	if (hdr->hops >= CONFIG_RELAY_CHAIN_MAX_HOPS) {
+		stats.too_far++;
+		return;
+	}
+
+	s = stream_get(hdr->origin, hdr->node);
+	if (seq_window_rx(&s->window, sys_le16_to_cpu(hdr->seq), link) == SEQ_DUP) {
+		stats.dups++;
+		return;
+	}
+
+	link_stat_inc(link, LINK_STAT_RX);
+	link_stat_add(link, LINK_STAT_RX_BYTES, len - sizeof(*hdr));
+	if (!relay_frame_forward(link, hdr, &data[sizeof(*hdr)], len - sizeof(*hdr))) {
+		stats.forwarded++;
+	}
+}
+
+static uint8_t chain_notify(struct bt_conn *conn, struct bt_gatt_subscribe_params *params,
+			    const void *data, uint16_t length)
+{
+	struct relay_link *link = link_get(conn);
+
+	if (!data || !link) {
+		params->value_handle = 0U;
+		return BT_GATT_ITER_STOP;
+	}
+
+	chain_rx(link, data, length);
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static void chain_sub_init(struct relay_link *link, uint16_t ccc_handle)
+{
+	link->chain_sub.notify = chain_notify;
+	link->chain_sub.value = BT_GATT_CCC_NOTIFY;
+	link->chain_sub.ccc_handle = ccc_handle;
+	atomic_set_bit(link->chain_sub.flags, BT_GATT_SUBSCRIBE_FLAG_VOLATILE);
+}
+
+/* Discovery is over, with or without a relay frame characteristic; let a
+ * bonded node skip it next time.
+ */
+static void chain_checked(struct relay_link *link)
+{
+	link->chain_checked = true;
+	resume_save(link);
+}
+
+static uint8_t chain_discover_func(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				   struct bt_gatt_discover_params *params)
+{
+	struct relay_link *link = link_get(conn);
+	int err;
+
+	if (!link) {
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (!attr) {
+		/* No relay frame characteristic, or no CCC on it. */
+		link->chain_sub.value_handle = 0U;
+		chain_checked(link);
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (params->type == BT_GATT_DISCOVER_CHARACTERISTIC) {
+		link->chain_sub.value_handle = bt_gatt_attr_value_handle(attr);
+		params->uuid = &ccc_uuid.uuid;
+		params->start_handle = attr->handle + 2;
+		params->type = BT_GATT_DISCOVER_DESCRIPTOR;
+
+		err = bt_gatt_discover(conn, params);
+		if (err) {
+			printk("Discover failed (err %d)\n", err);
+		}
+		return BT_GATT_ITER_STOP;
+	}
+
+	chain_sub_init(link, attr->handle);
+
+	err = bt_gatt_subscribe(conn, &link->chain_sub);
+	if (err && err != -EALREADY) {
+		printk("Subscribe failed (err %d)\n", err);
+		return BT_GATT_ITER_STOP;
+	}
+
+	link->chained = true;
+	printk("Node %u is a relay, forwarding its frames\n", link->id);
+	chain_checked(link);
+
+	return BT_GATT_ITER_STOP;
+}
+
+void chain_discover(struct relay_link *link)
+{
+	struct bt_gatt_discover_params *params = &link->chain_discover;
+	int err;
+
+	params->uuid = &frame_uuid.uuid;
+	params->func = chain_discover_func;
+	params->start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	params->end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+	params->type = BT_GATT_DISCOVER_CHARACTERISTIC;
+
+	err = bt_gatt_discover(link->conn, params);
+	if (err) {
+		printk("Discover failed (err %d)\n", err);
+	}
+}
+
+int chain_resume(struct relay_link *link, uint16_t value_handle, uint16_t ccc_handle)
+{
+	int err;
+
+	link->chain_checked = true;
+
+	if (!value_handle || !ccc_handle) {
+		return 0;
+	}
+
+	link->chain_sub.value_handle = value_handle;
+	chain_sub_init(link, ccc_handle);
+
+	/* As for the profile: the node kept the CCC for the bond. */
+	err = bt_gatt_resubscribe(BT_ID_DEFAULT, bt_conn_get_dst(link->conn), &link->chain_sub);
+	if (err && err != -EALREADY) {
+		printk("Resubscribe failed (err %d)\n", err);
+		link->chain_checked = false;
+		return err;
+	}
+
+	link->chained = true;
+	printk("Node %u is a relay, forwarding its frames\n", link->id);
+
+	return 0;
+}
+
+bool chain_handles(const struct relay_link *link, uint16_t *value_handle,
+		   uint16_t *ccc_handle)
+{
+	if (!link->chain_checked) {
+		return false;
+	}
+
+	*value_handle = link->chained ? link->chain_sub.value_handle : 0U;
+	*ccc_handle = link->chained ? link->chain_sub.ccc_handle : 0U;
+
+	return true;
+}
+
+void chain_stats_get(struct chain_stats *out)
+{
+	*out = stats;
+}
@@ -0,0 +1,70 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef CHAIN_H_
+#define CHAIN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "link.h"
+
+struct chain_stats {
+	uint32_t forwarded;
+	uint32_t dups;      /* seen before, on this or another path */
+	uint32_t loops;     /* our own frames coming back */
+	uint32_t too_far;   /* dropped at the hop limit */
+};
+
+#if defined(CONFIG_RELAY_CHAIN)
+/* Look for the relay frame characteristic on a node, and forward the
+ * frames of a node that turns out to be a relay.
+ */
+void chain_discover(struct relay_link *link);
+
+/* Restore the subscription to a bonded relay node's frames from cached
+ * handles, like profile_resume(); with no handles the node is known not
+ * to be a relay and nothing is looked up.
+ */
+int chain_resume(struct relay_link *link, uint16_t value_handle, uint16_t ccc_handle);
+
+/* Handles to cache for chain_resume(), zero for a node that is not a
+ * relay. Returns false while discovery has not finished.
+ */
+bool chain_handles(const struct relay_link *link, uint16_t *value_handle,
+		   uint16_t *ccc_handle);
+
+/* The node is a relay whose frames are forwarded as they are; its own
+ * mirrored characteristics are not framed again.
+ */
+static inline bool chain_is_relay(const struct relay_link *link)
+{
+	return link->chained;
+}
+
+void chain_stats_get(struct chain_stats *stats);
+#else
+static inline void chain_discover(struct relay_link *link)
+{
+}
+
+static inline int chain_resume(struct relay_link *link, uint16_t value_handle,
+			       uint16_t ccc_handle)
+{
+	return 0;
+}
+
+static inline bool chain_handles(const struct relay_link *link, uint16_t *value_handle,
+				 uint16_t *ccc_handle)
+{
+	return false;
+}
+
+static inline bool chain_is_relay(const struct relay_link *link)
+{
+	return false;
+}
+#endif
+
+#endif /* CHAIN_H_ */
@@ -0,0 +1,121 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#if defined(CONFIG_RELAY_SHELL)
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#endif
+
+#include "link.h"
+#include "relay_svc.h"
+
+#define DIAG_FORMAT 2
+
+/* version | links | counters per link, then per link:
+ * node | connected | counters in enum link_stat order (u32 LE each)
+ */
+struct diag_hdr {
+	uint8_t version;
+	uint8_t links;
+	uint8_t counters;
+} __packed;
+
+struct diag_link_rec {
+	uint8_t node;
+	uint8_t connected;
+	uint32_t v[LINK_STAT_COUNT];
+} __packed;
+
+struct diag_rsp {
+	struct diag_hdr hdr;
+	struct diag_link_rec recs[CONFIG_RELAY_MAX_NODES];
+} __packed;
+
+static ssize_t read_link_stats(struct bt_conn *conn,
+			       const struct bt_gatt_attr *attr, void *buf,
+			       uint16_t len, uint16_t offset)
+{
+	struct diag_rsp rsp = {
+		.hdr = {
+			.version = DIAG_FORMAT,
+			.links = CONFIG_RELAY_MAX_NODES,
+			.counters = LINK_STAT_COUNT,
+		},
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(rsp.recs); i++) {
+		struct diag_link_rec *rec = &rsp.recs[i];
+
+		rec->node = i;
+		rec->connected = (links[i].conn != NULL);
+		for (size_t j = 0; j < LINK_STAT_COUNT; j++) {
+			rec->v[j] = sys_cpu_to_le32(atomic_get(&link_stats[i].v[j]));
+		}
+	}
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &rsp, sizeof(rsp));
+}
+
+BT_GATT_SERVICE_DEFINE(diag_svc,
+	BT_GATT_PRIMARY_SERVICE(DIAG_SERVICE_UUID),
+	BT_GATT_CHARACTERISTIC(DIAG_LINK_STATS_CHAR_UUID,
+			       BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ, read_link_stats, NULL, NULL),
+);
+
+#if defined(CONFIG_RELAY_SHELL)
+static void print_link(const struct shell *sh, size_t i)
+{
+	shell_print(sh, "node %u (%s)", i, links[i].conn ? "connected" : "idle");
+
+	for (size_t j = 0; j < LINK_STAT_COUNT; j++) {
+		shell_print(sh, "  %-12u %s", (uint32_t)atomic_get(&link_stats[i].v[j]),
+			    link_stat_names[j]);
+	}
+}
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	if (argc > 1) {
+		unsigned long node = strtoul(argv[1], NULL, 0);
+
+		if (node >= CONFIG_RELAY_MAX_NODES) {
+			shell_error(sh, "node %lu out of range", node);
+			return -EINVAL;
+		}
+		print_link(sh, node);
+		return 0;
+	}
+
+	for (size_t i = 0; i < CONFIG_RELAY_MAX_NODES; i++) {
+		print_link(sh, i);
+	}
+
+	return 0;
+}
+
+static int cmd_stats_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	link_stats_reset();
+	shell_print(sh, "link counters cleared");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(relay_stats_cmds,
+	SHELL_CMD_ARG(reset, NULL, "Clear all link counters", cmd_stats_reset, 1, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(relay_cmds,
+	SHELL_CMD_ARG(stats, &relay_stats_cmds, "Link counters [node]", cmd_stats, 1, 1),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(relay, &relay_cmds, "Relay commands", NULL);
+#endif
@@ -0,0 +1,108 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Periodic relay work. One k_timer is armed for the earliest deadline of
+ * the task table below and hands the due tasks to the system workqueue,
+ * so nothing wakes the CPU between deadlines.
+ */
+
+#include <zephyr/kernel.h>
+
+#include <dk_buttons_and_leds.h>
+
+#include "housekeeping.h"
+#include "mesh.h"
+#include "profile.h"
+#include "resume.h"
+#include "scan_sched.h"
+#include "tx_sched.h"
+
+#define RUN_STATUS_LED DK_LED1
+
+struct hk_task {
+	void (*fn)(void);
+	uint32_t period_ms;  /* 0 disables the task */
+	int64_t due;
+};
+
+#define HK_TASK(_fn, _period_ms) { .fn = _fn, .period_ms = (_period_ms) }
+
+static void blink(void);
+
+static struct hk_task tasks[] = {
+	HK_TASK(blink, CONFIG_RELAY_HK_BLINK_MS),
+	HK_TASK(profile_shadow_expire, CONFIG_RELAY_SHADOW_TTL_SEC ? 1000 : 0),
+	HK_TASK(scan_sched_update, CONFIG_RELAY_HK_SCAN_SEC * 1000),
+	HK_TASK(resume_flush, CONFIG_RELAY_HK_FLUSH_MS),
+	HK_TASK(scan_sched_report, CONFIG_RELAY_SCAN_REPORT_SEC * 1000),
+#if defined(CONFIG_RELAY_MESH)
+	HK_TASK(mesh_report, CONFIG_RELAY_MESH_REPORT_SEC * 1000),
+#endif
+#if defined(CONFIG_RELAY_TX_LOAD_TEST)
+	HK_TASK(tx_sched_load_report, CONFIG_RELAY_TX_LOAD_TEST_REPORT_SEC * 1000),
+#endif
+};
+
+static void hk_expiry(struct k_timer *timer);
+static void hk_work_handler(struct k_work *work);
+
+static K_TIMER_DEFINE(hk_timer, hk_expiry, NULL);
+static K_WORK_DEFINE(hk_work, hk_work_handler);
+
+static void blink(void)
+{
+	static bool on;
+
+	on = !on;
+	dk_set_led(RUN_STATUS_LED, on);
+}
+
+static void hk_expiry(struct k_timer *timer)
+{
+	k_work_submit(&hk_work);
+}
+
+static void hk_work_handler(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+	int64_t next = INT64_MAX;
+
+	for (size_t i = 0; i < ARRAY_SIZE(tasks); i++) {
+		struct hk_task *t = &tasks[i];
+
+		if (!t->period_ms) {
+			continue;
+		}
+
+		if (t->due <= now) {
+			t->fn();
+
+			/* Keep the phase; skip periods missed while busy. */
+			t->due += t->period_ms;
+			if (t->due <= now) {
+				t->due = now + t->period_ms;
+			}
+		}
+
+		next = MIN(next, t->due);
+	}
+
+	if (next != INT64_MAX) {
+		k_timer_start(&hk_timer, K_MSEC(next - now), K_NO_WAIT);
+	}
+}
+
+void housekeeping_start(void)
+{
+	int64_t now = k_uptime_get();
+
+	for (size_t i = 0; i < ARRAY_SIZE(tasks); i++) {
+		tasks[i].due = now + tasks[i].period_ms;
+	}
+
+	/* The blink starts right away, the rest after one period. */
+	tasks[0].due = now;
+
+	k_work_submit(&hk_work);
+}
@@ -0,0 +1,14 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef HOUSEKEEPING_H_
+#define HOUSEKEEPING_H_
+
+/* Start the periodic tasks: status LED blink, relayed value expiry, scan
+ * policy, settings flush and the statistics reports. Call once the stack
+ * is up; the main thread is not needed afterwards.
+ */
+void housekeeping_start(void);
+
+#endif /* HOUSEKEEPING_H_ */
@@ -0,0 +1,137 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+
+#include <string.h>
+
+#include "link.h"
+#include "relay_bt.h"
+
+#define SEQ_WINDOW 32
+
+struct relay_link links[CONFIG_RELAY_MAX_NODES];
+struct link_stats link_stats[CONFIG_RELAY_MAX_NODES];
+static bool link_used[CONFIG_RELAY_MAX_NODES];
+static uint16_t tx_seq[CONFIG_RELAY_MAX_NODES];
+
+#define LINK_STAT_NAME(_name, _desc) [LINK_STAT_##_name] = _desc,
+
+const char *const link_stat_names[LINK_STAT_COUNT] = {
+	LINK_STATS(LINK_STAT_NAME)
+};
+
+struct relay_link *link_alloc(struct bt_conn *conn)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		struct relay_link *link = &links[i];
+
+		if (!link->conn) {
+			memset(link, 0, sizeof(*link));
+			link->id = i;
+			link->conn = relay_bt_conn_ref(conn);
+
+			if (link_used[i]) {
+				link_stat_inc(link, LINK_STAT_RECONNECTS);
+			}
+			link_used[i] = true;
+
+			return link;
+		}
+	}
+
+	return NULL;
+}
+
+void link_free(struct relay_link *link)
+{
+	relay_bt_conn_unref(link->conn);
+	link->conn = NULL;
+}
+
+struct relay_link *link_get(const struct bt_conn *conn)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		if (conn && links[i].conn == conn) {
+			return &links[i];
+		}
+	}
+
+	return NULL;
+}
+
+void link_stat_inc_conn(const struct bt_conn *conn, enum link_stat stat)
+{
+	struct relay_link *link = link_get(conn);
+
+	if (link) {
+		link_stat_inc(link, stat);
+	}
+}
+
+void link_stats_reset(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(link_stats); i++) {
+		for (size_t j = 0; j < LINK_STAT_COUNT; j++) {
+			atomic_clear(&link_stats[i].v[j]);
+		}
+	}
+}
+
+size_t link_count(void)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		if (links[i].conn) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+uint16_t link_tx_seq_next(const struct relay_link *link)
+{
+	return tx_seq[link->id]++;
+}
+
+enum seq_result seq_window_rx(struct seq_window *w, uint16_t seq, struct relay_link *link)
+{
+	int16_t delta = (int16_t)(seq - w->last);
+
+	if (!w->valid || delta <= -SEQ_WINDOW) {
+		/* First frame, or the sender restarted its counter. Nothing
+		 * older was counted as a gap, so a late frame from before is
+		 * taken as a duplicate rather than a hole filled.
+		 */
+		w->valid = true;
+		w->last = seq;
+		w->seen = UINT32_MAX;
+		return SEQ_IN_ORDER;
+	}
+
+	if (delta > 0) {
+		w->seen = (delta < SEQ_WINDOW) ? (w->seen << delta) | 1 : 1;
+		w->last = seq;
+
+		if (delta > 1) {
+			link_stat_add(link, LINK_STAT_GAPS, delta - 1);
+			return SEQ_GAP;
+		}
+		return SEQ_IN_ORDER;
+	}
+
+	if (w->seen & BIT(-delta)) {
+		link_stat_inc(link, LINK_STAT_DUPS);
+		return SEQ_DUP;
+	}
+
+	/* Late arrival fills a hole that was counted as a gap. */
+	w->seen |= BIT(-delta);
+	link_stat_add(link, LINK_STAT_GAPS, -1);
+	link_stat_inc(link, LINK_STAT_REORDERS);
+
+	return SEQ_REORDER;
+}
@@ -0,0 +1,136 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef LINK_H_
+#define LINK_H_
+
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/atomic.h>
+
+#include "profile.h"
+
+/* Per-link counters: name, description. They live outside the link slot,
+ * so they keep counting across reconnects, and are updated with atomics
+ * from any context.
+ */
+#define LINK_STATS(X)								\
+	X(RX, "notifications received from the node")				\
+	X(RX_BYTES, "value bytes relayed from the node")			\
+	X(TX, "frames queued towards the hubs")					\
+	X(TX_FAIL, "frames dropped or superseded, writes to the node failed")	\
+	X(WRITES, "writes routed to the node")					\
+	X(ATT_TIMEOUTS, "requests aborted by an ATT timeout")			\
+	X(NO_BUF, "relay queue full")						\
+	X(RECONNECTS, "connections after the first on this link")		\
+	X(DISCOVERY_MS, "time to subscribe at the last connection")		\
+	X(GAPS, "sequence numbers skipped in received frames")			\
+	X(DUPS, "duplicate frames")						\
+	X(REORDERS, "frames received out of order")
+
+#define LINK_STAT_ENUM(_name, _desc) LINK_STAT_##_name,
+
+enum link_stat {
+	LINK_STATS(LINK_STAT_ENUM)
+
+	LINK_STAT_COUNT
+};
+
+struct link_stats {
+	atomic_t v[LINK_STAT_COUNT];
+};
+
+extern struct link_stats link_stats[CONFIG_RELAY_MAX_NODES];
+extern const char *const link_stat_names[LINK_STAT_COUNT];
+
+/* Sliding window over the last 32 sequence numbers seen on a link. */
+struct seq_window {
+	uint16_t last;
+	uint32_t seen;
+	bool valid;
+};
+
+enum seq_result {
+	SEQ_IN_ORDER,
+	SEQ_GAP,
+	SEQ_DUP,
+	SEQ_REORDER,
+};
+
+struct relay_link {
+	struct bt_conn *conn;
+	uint8_t id;
+	struct bt_uuid_16 discover_uuid[LINK_CHR_COUNT];
+	struct bt_gatt_discover_params discover_params[LINK_CHR_COUNT];
+	struct bt_gatt_subscribe_params subscribe_params[LINK_CHR_COUNT];
+	int64_t connected_at;
+	bool rx_seen;
+	uint8_t subscribed;
+	uint8_t settled; /* characteristics subscribed or found absent, by bit */
+	bool resumed;   /* subscriptions restored from the bond cache */
+#if defined(CONFIG_RELAY_CHAIN)
+	/* Relay frame characteristic of a node that is itself a relay. */
+	struct bt_gatt_discover_params chain_discover;
+	struct bt_gatt_subscribe_params chain_sub;
+	bool chained;
+	bool chain_checked; /* relay frame discovery finished */
+#endif
+};
+
+extern struct relay_link links[CONFIG_RELAY_MAX_NODES];
+
+struct relay_link *link_alloc(struct bt_conn *conn);
+void link_free(struct relay_link *link);
+struct relay_link *link_get(const struct bt_conn *conn);
+size_t link_count(void);
+
+/* Value handle of a relayed characteristic, 0 until discovered. */
+static inline uint16_t link_handle(const struct relay_link *link, enum link_chr chr)
+{
+	return link->subscribe_params[chr].value_handle;
+}
+
+/* Every profile characteristic was subscribed or found missing. */
+static inline bool link_settled(const struct relay_link *link)
+{
+	return link->settled == BIT_MASK(LINK_CHR_COUNT);
+}
+
+/* Next sequence number for a frame from the link. It runs per slot across
+ * reconnects, like the counters, since receivers keep their windows per
+ * node id: a reused slot must not start over and look like duplicates.
+ */
+uint16_t link_tx_seq_next(const struct relay_link *link);
+
+/* Classify a sequence number received on a stream and update the gap,
+ * duplicate and reorder counters of the link it arrived on.
+ */
+enum seq_result seq_window_rx(struct seq_window *w, uint16_t seq, struct relay_link *link);
+
+static inline void link_stat_add(const struct relay_link *link, enum link_stat stat,
+				 atomic_val_t n)
+{
+	atomic_add(&link_stats[link->id].v[stat], n);
+}
+
+static inline void link_stat_inc(const struct relay_link *link, enum link_stat stat)
+{
+	atomic_inc(&link_stats[link->id].v[stat]);
+}
+
+static inline void link_stat_set(const struct relay_link *link, enum link_stat stat,
+				 atomic_val_t value)
+{
+	atomic_set(&link_stats[link->id].v[stat], value);
+}
+
+/* For callers that only have the connection; a no-op for hub
+ * connections.
+ */
+void link_stat_inc_conn(const struct bt_conn *conn, enum link_stat stat);
+
+void link_stats_reset(void);
+
+#endif /* LINK_H_ */
@@ -0,0 +1,254 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Mesh bridge. The relay is a mesh node with a Sensor Server publishing
+ * the temperature it gets from GATT nodes, and a Generic OnOff Client
+ * that forwards hub LED writes to mesh nodes. Both ride on managed
+ * flooding; legacy nodes keep using the GATT path.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/drivers/hwinfo.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <string.h>
+
+#include "mesh.h"
+#include "tx_sched.h"
+
+#define COMPANY_ID_NORDIC 0x0059
+
+#define OP_SENSOR_GET   BT_MESH_MODEL_OP_2(0x82, 0x31)
+#define OP_SENSOR_STATUS BT_MESH_MODEL_OP_1(0x52)
+#define OP_ONOFF_SET    BT_MESH_MODEL_OP_2(0x82, 0x02)
+#define OP_ONOFF_STATUS BT_MESH_MODEL_OP_2(0x82, 0x04)
+
+/* Present Ambient Temperature, a Temperature 8 value in 0.5 degree steps. */
+#define PROP_AMBIENT_TEMP 0x004f
+#define SENSOR_STATUS_LEN 3
+
+static uint8_t dev_uuid[16];
+static int8_t temp8;
+static uint8_t onoff_tid;
+static int64_t onoff_sent_at;
+static struct mesh_stats stats;
+static uint64_t rtt_total_ms;
+
+static void scan_work_handler(struct k_work *work);
+static K_WORK_DEFINE(scan_work, scan_work_handler);
+
+/* Marshalled Sensor Data, format A: one property with a 1-byte value. */
+static void sensor_data_add(struct net_buf_simple *buf)
+{
+	net_buf_simple_add_le16(buf, ((sizeof(temp8) - 1) << 1) | (PROP_AMBIENT_TEMP << 5));
+	net_buf_simple_add_u8(buf, temp8);
+}
+
+static int sensor_get(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
+		      struct net_buf_simple *buf)
+{
+	BT_MESH_MODEL_BUF_DEFINE(msg, OP_SENSOR_STATUS, SENSOR_STATUS_LEN);
+
+	/* A Get for any other property gets an empty status. */
+	bt_mesh_model_msg_init(&msg, OP_SENSOR_STATUS);
+	if (buf->len < 2 || net_buf_simple_pull_le16(buf) == PROP_AMBIENT_TEMP) {
+		sensor_data_add(&msg);
+	}
+
+	return bt_mesh_model_send(model, ctx, &msg, NULL, NULL);
+}
+
+static int onoff_status(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
+			struct net_buf_simple *buf)
+{
+	const struct profile_chr *pc = &profile_chrs[LINK_CHR_LED];
+	uint8_t present = net_buf_simple_pull_u8(buf);
+	uint32_t rtt;
+
+	/* Every server in the group answers; the first one times the Set. */
+	if (onoff_sent_at) {
+		rtt = k_uptime_get() - onoff_sent_at;
+		onoff_sent_at = 0;
+
+		stats.onoff_acked++;
+		rtt_total_ms += rtt;
+		stats.rtt_avg_ms = rtt_total_ms / stats.onoff_acked;
+		stats.rtt_max_ms = MAX(stats.rtt_max_ms, rtt);
+	}
+
+	pc->value[0] = present;
+	tx_sched_notify(pc->cls, profile_attr(LINK_CHR_LED), pc->value, pc->size);
+
+	return 0;
+}
+
+static const struct bt_mesh_model_op sensor_srv_op[] = {
+	{ OP_SENSOR_GET, BT_MESH_LEN_MIN(0), sensor_get },
+	BT_MESH_MODEL_OP_END,
+};
+
+static const struct bt_mesh_model_op onoff_cli_op[] = {
+	{ OP_ONOFF_STATUS, BT_MESH_LEN_MIN(1), onoff_status },
+	BT_MESH_MODEL_OP_END,
+};
+
+BT_MESH_MODEL_PUB_DEFINE(sensor_pub, NULL, 1 + SENSOR_STATUS_LEN);
+BT_MESH_MODEL_PUB_DEFINE(onoff_pub, NULL, 2 + 2);
+
+static struct bt_mesh_health_srv health_srv;
+BT_MESH_HEALTH_PUB_DEFINE(health_pub, 0);
+
+static struct bt_mesh_model models[] = {
+	BT_MESH_MODEL_CFG_SRV,
+	BT_MESH_MODEL_HEALTH_SRV(&health_srv, &health_pub),
+	BT_MESH_MODEL(BT_MESH_MODEL_ID_SENSOR_SRV, sensor_srv_op, &sensor_pub, NULL),
+	BT_MESH_MODEL(BT_MESH_MODEL_ID_GEN_ONOFF_CLI, onoff_cli_op, &onoff_pub, NULL),
+};
+
+#define SENSOR_SRV (&models[2])
+#define ONOFF_CLI  (&models[3])
+
+static struct bt_mesh_elem elements[] = {
+	BT_MESH_ELEM(0, models, BT_MESH_MODEL_NONE),
+};
+
+static const struct bt_mesh_comp comp = {
+	.cid = COMPANY_ID_NORDIC,
+	.elem = elements,
+	.elem_count = ARRAY_SIZE(elements),
+};
+
+static void prov_complete(uint16_t net_idx, uint16_t addr)
+{
+	printk("Mesh provisioned, address 0x%04x\n", addr);
+}
+
+static void prov_reset(void)
+{
+	bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
+}
+
+static const struct bt_mesh_prov prov = {
+	.uuid = dev_uuid,
+	.complete = prov_complete,
+	.reset = prov_reset,
+};
+
+void mesh_relay(enum link_chr chr, const void *data, uint16_t len)
+{
+	int err;
+
+	int16_t centi;
+
+	if (chr != LINK_CHR_TEMP || len < sizeof(centi)) {
+		return;
+	}
+
+	/* 0.01 degree units to the nearest 0.5 degree step. */
+	centi = sys_get_le16(data);
+	temp8 = CLAMP((centi + (centi < 0 ? -25 : 25)) / 50, INT8_MIN, INT8_MAX);
+
+	bt_mesh_model_msg_init(sensor_pub.msg, OP_SENSOR_STATUS);
+	sensor_data_add(sensor_pub.msg);
+
+	/* Nothing to do until a publication address is configured. */
+	err = bt_mesh_model_publish(SENSOR_SRV);
+	if (!err) {
+		stats.temp_published++;
+	}
+}
+
+int mesh_route_write(enum link_chr chr, const void *data, uint16_t len)
+{
+	int err;
+
+	if (chr != LINK_CHR_LED || !len) {
+		return -ENOTSUP;
+	}
+
+	bt_mesh_model_msg_init(onoff_pub.msg, OP_ONOFF_SET);
+	net_buf_simple_add_u8(onoff_pub.msg, !!*(const uint8_t *)data);
+	net_buf_simple_add_u8(onoff_pub.msg, onoff_tid++);
+
+	err = bt_mesh_model_publish(ONOFF_CLI);
+	if (err) {
+		return err;
+	}
+
+	/* A Set still waiting for its status counts as lost. */
+	stats.onoff_sent++;
+	onoff_sent_at = k_uptime_get();
+
+	return 0;
+}
+
+void mesh_stats_get(struct mesh_stats *out)
+{
+	*out = stats;
+}
+
+/* The scan module stops the scanner to connect to a GATT node, and the
+ * mesh only starts it again on resume.
+ */
+static void scan_work_handler(struct k_work *work)
+{
+	if (!bt_mesh_is_provisioned()) {
+		return;
+	}
+
+	bt_mesh_suspend();
+	bt_mesh_resume();
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct bt_conn_info info;
+
+	if (!bt_conn_get_info(conn, &info) && info.role == BT_CONN_ROLE_CENTRAL) {
+		k_work_submit(&scan_work);
+	}
+}
+
+BT_CONN_CB_DEFINE(mesh_conn_callbacks) = {
+	.connected = connected,
+};
+
+void mesh_report(void)
+{
+	printk("[MESH] temp published %u, onoff sets %u acked %u (%u%%) rtt avg %u ms max %u ms\n",
+	       stats.temp_published, stats.onoff_sent, stats.onoff_acked,
+	       stats.onoff_sent ? stats.onoff_acked * 100 / stats.onoff_sent : 0,
+	       stats.rtt_avg_ms, stats.rtt_max_ms);
+}
+
+int mesh_init(void)
+{
+	int err;
+
+	err = hwinfo_get_device_id(dev_uuid, sizeof(dev_uuid));
+	if (err < 0) {
+		return err;
+	}
+
+	err = bt_mesh_init(&prov, &comp);
+	if (err) {
+		printk("Mesh init failed (err %d)\n", err);
+		return err;
+	}
+
+	return 0;
+}
+
+void mesh_start(void)
+{
+	int err;
+
+	err = bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
+	if (err && err != -EALREADY) {
+		printk("Mesh provisioning failed to start (err %d)\n", err);
+	}
+}
@@ -0,0 +1,60 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MESH_H_
+#define MESH_H_
+
+#include <errno.h>
+#include <stdint.h>
+
+#include "profile.h"
+
+struct mesh_stats {
+	uint32_t temp_published;
+	uint32_t onoff_sent;    /* acknowledged OnOff Sets published */
+	uint32_t onoff_acked;   /* Sets answered by at least one OnOff Status */
+	uint32_t rtt_avg_ms;
+	uint32_t rtt_max_ms;
+};
+
+#if defined(CONFIG_RELAY_MESH)
+/* Register the mesh models; call after bt_enable() and before
+ * settings_load(), which restores the provisioning data.
+ */
+int mesh_init(void);
+
+/* Advertise for provisioning unless already provisioned. */
+void mesh_start(void);
+
+/* Mirror a value relayed from a GATT node, or a hub write routed to the
+ * GATT nodes, onto the mesh.
+ */
+void mesh_relay(enum link_chr chr, const void *data, uint16_t len);
+int mesh_route_write(enum link_chr chr, const void *data, uint16_t len);
+
+void mesh_stats_get(struct mesh_stats *stats);
+
+/* Print the OnOff delivery ratio and round-trip time. */
+void mesh_report(void);
+#else
+static inline int mesh_init(void)
+{
+	return 0;
+}
+
+static inline void mesh_start(void)
+{
+}
+
+static inline void mesh_relay(enum link_chr chr, const void *data, uint16_t len)
+{
+}
+
+static inline int mesh_route_write(enum link_chr chr, const void *data, uint16_t len)
+{
+	return -ENOTSUP;
+}
+#endif
+
+#endif /* MESH_H_ */
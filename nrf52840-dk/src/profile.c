@@ -0,0 +1,439 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <string.h>
+
+#include "chain.h"
+#include "link.h"
+#include "mesh.h"
+#include "profile.h"
+#include "relay_bt.h"
+#include "relay_svc.h"
+#include "resume.h"
+#include "tx_sched.h"
+#include "upstream.h"
+
+#define PROFILE_PERM(props)						\
+	((((props) & BT_GATT_CHRC_READ) ? BT_GATT_PERM_READ : 0) |	\
+	 (((props) & BT_GATT_CHRC_WRITE) ? BT_GATT_PERM_WRITE : 0))
+
+static ssize_t profile_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			    void *buf, uint16_t len, uint16_t offset);
+static ssize_t profile_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			     const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+static void ccc_changed(const struct bt_gatt_attr *attr, uint16_t value);
+static ssize_t ccc_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			 uint16_t value);
+
+#define PROFILE_VALUE(_name, _svc, _chr, _props, _size, _cls)	\
+	BUILD_ASSERT(_size <= CONFIG_RELAY_TX_VALUE_MAX);		\
+	static uint8_t value_##_name[_size];
+
+RELAY_PROFILE(PROFILE_VALUE)
+
+/* CCC state is kept per hub by the stack; the write hook lets each hub
+ * get its own initial value when it subscribes.
+ */
+#define PROFILE_CCC(_name, ...) \
+	[LINK_CHR_##_name] = BT_GATT_CCC_INITIALIZER(ccc_changed, ccc_write, NULL),
+
+static struct _bt_gatt_ccc ccc[LINK_CHR_COUNT] = {
+	RELAY_PROFILE(PROFILE_CCC)
+};
+
+#define PROFILE_SVC(_name, _svc, _chr, _props, _size, _cls)			\
+	BT_GATT_SERVICE_DEFINE(profile_svc_##_name,				\
+		BT_GATT_PRIMARY_SERVICE(BT_UUID_DECLARE_16(_svc)),		\
+		BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(_chr), _props,	\
+				       PROFILE_PERM(_props),			\
+				       profile_read, profile_write,		\
+				       (void *)&profile_chrs[LINK_CHR_##_name]), \
+		BT_GATT_CCC_MANAGED(&ccc[LINK_CHR_##_name],			\
+				    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),	\
+	);
+
+RELAY_PROFILE(PROFILE_SVC)
+
+#define PROFILE_ROW(_name, _svc, _chr, _props, _size, _cls)		\
+	[LINK_CHR_##_name] = {						\
+		.name = #_name,						\
+		.svc_uuid = _svc,					\
+		.chr_uuid = _chr,					\
+		.size = _size,						\
+		.cls = _cls,						\
+		.value = value_##_name,					\
+		.svc = &profile_svc_##_name,				\
+	},
+
+const struct profile_chr profile_chrs[LINK_CHR_COUNT] = {
+	RELAY_PROFILE(PROFILE_ROW)
+};
+
+static struct bt_gatt_read_params read_params[LINK_CHR_COUNT];
+static bool reading[LINK_CHR_COUNT];
+/* Uptime of the last value received per characteristic, 0 once expired. */
+static int64_t value_at[LINK_CHR_COUNT];
+
+/* Widen a legacy 1-byte temperature to sint16 in 0.01 degree units;
+ * everything else passes through.
+ */
+static const void *normalize(enum link_chr chr, const void *data, uint16_t *length,
+			     uint8_t *buf)
+{
+	if (chr != LINK_CHR_TEMP || *length != 1) {
+		return data;
+	}
+
+	sys_put_le16(*(const int8_t *)data * 100, buf);
+	*length = sizeof(int16_t);
+
+	return buf;
+}
+
+static inline enum link_chr chr_of(const struct bt_gatt_attr *attr)
+{
+	return (const struct profile_chr *)attr->user_data - profile_chrs;
+}
+
+static uint8_t read_func(struct bt_conn *conn, uint8_t err,
+			 struct bt_gatt_read_params *params,
+			 const void *data, uint16_t length)
+{
+	enum link_chr chr = params - read_params;
+	const struct profile_chr *pc = &profile_chrs[chr];
+	uint8_t wide[sizeof(int16_t)];
+
+	if (!err && data) {
+		data = normalize(chr, data, &length, wide);
+		memcpy(pc->value, data, MIN(length, pc->size));
+		value_at[chr] = k_uptime_get();
+		printk("[READ DATA] %s handle %u\n", pc->name, params->single.handle);
+	}
+	reading[chr] = false;
+
+	return BT_GATT_ITER_STOP;
+}
+
+static ssize_t profile_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			    void *buf, uint16_t len, uint16_t offset)
+{
+	enum link_chr chr = chr_of(attr);
+	const struct profile_chr *pc = &profile_chrs[chr];
+
+	/* Refresh from the first node; the reply updates the next read. */
+	for (size_t i = 0; i < ARRAY_SIZE(links) && !reading[chr]; i++) {
+		uint16_t handle = link_handle(&links[i], chr);
+
+		if (links[i].conn && handle) {
+			read_params[chr].func = read_func;
+			read_params[chr].handle_count = 1;
+			read_params[chr].single.handle = handle;
+			read_params[chr].single.offset = 0;
+			reading[chr] = !relay_bt_read(links[i].conn, &read_params[chr]);
+			break;
+		}
+	}
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, pc->value, pc->size);
+}
+
+int profile_route_write(enum link_chr chr, const void *buf, uint16_t len)
+{
+	int sent = 0;
+	int err = 0;
+	int ret;
+
+	/* Commands go out ahead of any queued telemetry. */
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		uint16_t handle = link_handle(&links[i], chr);
+
+		if (!links[i].conn || !handle) {
+			continue;
+		}
+
+		ret = tx_sched_write(links[i].conn, handle, buf, len);
+		if (ret) {
+			if (!err) {
+				err = ret;
+			}
+		} else {
+			sent++;
+		}
+	}
+
+	if (!mesh_route_write(chr, buf, len)) {
+		sent++;
+	}
+
+	if (sent) {
+		return sent;
+	}
+
+	return err ? err : -ENOTCONN;
+}
+
+static ssize_t profile_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			     const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	int err;
+
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	err = profile_route_write(chr_of(attr), buf, len);
+	if (err < 0) {
+		printk("write error! (err %d)\n", err);
+		return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+	}
+
+	printk("write request succeeded\n");
+
+	return len;
+}
+
+static void ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	enum link_chr chr = (struct _bt_gatt_ccc *)attr->user_data - ccc;
+
+	printk("%s notifications %s\n", profile_chrs[chr].name,
+	       value == BT_GATT_CCC_NOTIFY ? "enabled" : "disabled");
+}
+
+static ssize_t ccc_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			 uint16_t value)
+{
+	enum link_chr chr = (struct _bt_gatt_ccc *)attr->user_data - ccc;
+	const struct profile_chr *pc = &profile_chrs[chr];
+
+	if (!(value & BT_GATT_CCC_NOTIFY)) {
+		upstream_purge(conn, profile_attr(chr));
+	} else if (value_at[chr]) {
+		/* Only a value some node refreshed recently. */
+		upstream_send_to(conn, pc->cls, profile_attr(chr), 0, pc->value, pc->size);
+	}
+
+	return sizeof(value);
+}
+
+void profile_relay(struct relay_link *link, enum link_chr chr,
+		   const void *data, uint16_t length)
+{
+	const struct profile_chr *pc = &profile_chrs[chr];
+	uint8_t wide[sizeof(int16_t)];
+	int err;
+
+	data = normalize(chr, data, &length, wide);
+	memcpy(pc->value, data, MIN(length, pc->size));
+	value_at[chr] = k_uptime_get();
+
+	if (!link->rx_seen) {
+		link->rx_seen = true;
+		resume_first_rx(link);
+	}
+
+	printk("[NOTIFICATION] node %u %s length %u\n", link->id, pc->name, length);
+	link_stat_inc(link, LINK_STAT_RX);
+	link_stat_add(link, LINK_STAT_RX_BYTES, length);
+	if (!chain_is_relay(link)) {
+		relay_frame_send(link, chr, data, length);
+	}
+	mesh_relay(chr, data, length);
+
+	err = tx_sched_notify(pc->cls, profile_attr(chr), pc->value, pc->size);
+	if (err < 0) {
+		printk("%s relay failed (err %d)\n", pc->name, err);
+	}
+}
+
+static uint8_t profile_notify(struct bt_conn *conn,
+			      struct bt_gatt_subscribe_params *params,
+			      const void *data, uint16_t length)
+{
+	struct relay_link *link = link_get(conn);
+
+	if (!data || !link) {
+		printk("[UNSUBSCRIBED]\n");
+		params->value_handle = 0U;
+		return BT_GATT_ITER_STOP;
+	}
+
+	profile_relay(link, params - link->subscribe_params, data, length);
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static void subscribe_init(struct bt_gatt_subscribe_params *sub, uint16_t ccc_handle)
+{
+	sub->notify = profile_notify;
+	sub->value = BT_GATT_CCC_NOTIFY;
+	sub->ccc_handle = ccc_handle;
+	/* Link slots are reused, so never let the stack keep these. */
+	atomic_set_bit(sub->flags, BT_GATT_SUBSCRIBE_FLAG_VOLATILE);
+}
+
+/* The bond cache only takes a node once every characteristic is settled,
+ * so a node lost halfway through discovery is discovered again in full.
+ */
+static void profile_settle(struct relay_link *link, enum link_chr chr)
+{
+	link->settled |= BIT(chr);
+	if (link_settled(link)) {
+		resume_save(link);
+	}
+}
+
+/* Each characteristic walks service -> characteristic -> CCC with its own
+ * discover params; the step is given by the discovery type, the UUID to
+ * match by the profile table.
+ */
+static uint8_t discover_func(struct bt_conn *conn,
+			     const struct bt_gatt_attr *attr,
+			     struct bt_gatt_discover_params *params)
+{
+	struct relay_link *link = link_get(conn);
+	struct bt_gatt_subscribe_params *sub;
+	enum link_chr chr;
+	int err;
+
+	if (!link) {
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (!attr) {
+		/* Not on this node; that is settled too. */
+		printk("Discover complete\n");
+		profile_settle(link, params - link->discover_params);
+		(void)memset(params, 0, sizeof(*params));
+		return BT_GATT_ITER_STOP;
+	}
+
+	printk("[ATTRIBUTE] handle %u\n", attr->handle);
+
+	chr = params - link->discover_params;
+	sub = &link->subscribe_params[chr];
+
+	switch (params->type) {
+	case BT_GATT_DISCOVER_PRIMARY:
+		link->discover_uuid[chr] =
+			(struct bt_uuid_16)BT_UUID_INIT_16(profile_chrs[chr].chr_uuid);
+		params->start_handle = attr->handle + 1;
+		params->type = BT_GATT_DISCOVER_CHARACTERISTIC;
+		break;
+	case BT_GATT_DISCOVER_CHARACTERISTIC:
+		link->discover_uuid[chr] =
+			(struct bt_uuid_16)BT_UUID_INIT_16(BT_UUID_GATT_CCC_VAL);
+		params->start_handle = attr->handle + 2;
+		params->type = BT_GATT_DISCOVER_DESCRIPTOR;
+		sub->value_handle = bt_gatt_attr_value_handle(attr);
+		break;
+	default:
+		subscribe_init(sub, attr->handle);
+
+		err = relay_bt_subscribe(conn, sub);
+		if (err && err != -EALREADY) {
+			printk("Subscribe failed (err %d)\n", err);
+		} else {
+			printk("[SUBSCRIBED] %s\n", profile_chrs[chr].name);
+			profile_settle(link, chr);
+			if (++link->subscribed == LINK_CHR_COUNT) {
+				link_stat_set(link, LINK_STAT_DISCOVERY_MS,
+					      k_uptime_get() - link->connected_at);
+			}
+		}
+
+		return BT_GATT_ITER_STOP;
+	}
+
+	err = relay_bt_discover(conn, params);
+	if (err) {
+		printk("Discover failed (err %d)\n", err);
+	}
+
+	return BT_GATT_ITER_STOP;
+}
+
+void profile_shadow_expire(void)
+{
+	int64_t now = k_uptime_get();
+
+	for (int chr = 0; chr < LINK_CHR_COUNT; chr++) {
+		if (value_at[chr] &&
+		    now - value_at[chr] > CONFIG_RELAY_SHADOW_TTL_SEC * MSEC_PER_SEC) {
+			value_at[chr] = 0;
+			printk("%s value expired\n", profile_chrs[chr].name);
+		}
+	}
+}
+
+void profile_discover(struct relay_link *link)
+{
+	for (int chr = 0; chr < LINK_CHR_COUNT; chr++) {
+		struct bt_gatt_discover_params *params = &link->discover_params[chr];
+		int err;
+
+		link->discover_uuid[chr] =
+			(struct bt_uuid_16)BT_UUID_INIT_16(profile_chrs[chr].svc_uuid);
+		params->uuid = &link->discover_uuid[chr].uuid;
+		params->func = discover_func;
+		params->start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+		params->end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+		params->type = BT_GATT_DISCOVER_PRIMARY;
+
+		err = relay_bt_discover(link->conn, params);
+		if (err) {
+			printk("Discover failed(err %d)\n", err);
+			return;
+		}
+	}
+}
+
+int profile_resume(struct relay_link *link, const uint16_t *value_handle,
+		   const uint16_t *ccc_handle, uint8_t absent)
+{
+	int resumed = 0;
+
+	/* All or nothing: a characteristic neither cached nor known to be
+	 * missing sends the node through discovery.
+	 */
+	for (int chr = 0; chr < LINK_CHR_COUNT; chr++) {
+		if (!(absent & BIT(chr)) && (!value_handle[chr] || !ccc_handle[chr])) {
+			return -ENOENT;
+		}
+	}
+
+	for (int chr = 0; chr < LINK_CHR_COUNT; chr++) {
+		struct bt_gatt_subscribe_params *sub = &link->subscribe_params[chr];
+		int err;
+
+		if (absent & BIT(chr)) {
+			continue;
+		}
+
+		sub->value_handle = value_handle[chr];
+		subscribe_init(sub, ccc_handle[chr]);
+
+		/* The node kept the CCC for the bond: only register the
+		 * subscription locally, no write.
+		 */
+		err = relay_bt_resubscribe(link->conn, sub);
+		if (err && err != -EALREADY) {
+			printk("Resubscribe failed (err %d)\n", err);
+			return err;
+		}
+		resumed++;
+	}
+
+	if (resumed) {
+		link->settled = BIT_MASK(LINK_CHR_COUNT);
+		link_stat_set(link, LINK_STAT_DISCOVERY_MS, k_uptime_get() - link->connected_at);
+	}
+
+	return resumed ? 0 : -ENOENT;
+}
@@ -0,0 +1,91 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+
+#include "tx_sched.h"
+
+#define CUSTOM_SERVICE_UUID_VAL  0x1234
+#define CUSTOM_LED_CHAR_UUID_VAL 0x5678
+
+/* Characteristics relayed from each node, declared once:
+ *
+ *   X(name, service UUID, characteristic UUID, properties, value size, class)
+ *
+ * Each entry becomes a LINK_CHR_<name> id, a service in the relay's static
+ * GATT database that mirrors the node's characteristic, and a row of the
+ * discovery match and notification dispatch tables. The traffic class is
+ * also what hubs filter the relayed value by.
+ *
+ * TEMP is the ESS Temperature: sint16 in 0.01 degree units. Values from
+ * nodes still sending the legacy single whole-degree byte are widened on
+ * the way in.
+ */
+#define RELAY_PROFILE(X)							\
+	X(TEMP, BT_UUID_ESS_VAL, BT_UUID_TEMPERATURE_VAL,			\
+	  BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,				\
+	  2, TX_CLASS_TELEMETRY)						\
+	X(LED, CUSTOM_SERVICE_UUID_VAL, CUSTOM_LED_CHAR_UUID_VAL,		\
+	  BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY |	\
+	  BT_GATT_CHRC_INDICATE,						\
+	  1, TX_CLASS_CONTROL)
+
+#define PROFILE_ENUM(_name, ...) LINK_CHR_##_name,
+
+enum link_chr {
+	RELAY_PROFILE(PROFILE_ENUM)
+
+	LINK_CHR_COUNT
+};
+
+struct profile_chr {
+	const char *name;
+	uint16_t svc_uuid;
+	uint16_t chr_uuid;
+	uint8_t size;
+	uint8_t cls;
+	uint8_t *value;  /* last value received from any node */
+	const struct bt_gatt_service_static *svc;
+};
+
+extern const struct profile_chr profile_chrs[LINK_CHR_COUNT];
+
+/* Local characteristic relaying chr to the hubs. */
+static inline const struct bt_gatt_attr *profile_attr(enum link_chr chr)
+{
+	return &profile_chrs[chr].svc->attrs[1];
+}
+
+struct relay_link;
+
+/* Discover and subscribe to every profile characteristic on a node. */
+void profile_discover(struct relay_link *link);
+
+/* Restore the subscriptions of a bonded node from handles cached at an
+ * earlier connection, instead of discovering. absent has a bit set for
+ * each characteristic the node was found not to have. Fails with -ENOENT,
+ * restoring nothing, unless every other characteristic has its handles.
+ */
+int profile_resume(struct relay_link *link, const uint16_t *value_handle,
+		   const uint16_t *ccc_handle, uint8_t absent);
+
+/* Relay a value received from a node to the hubs. */
+void profile_relay(struct relay_link *link, enum link_chr chr,
+		   const void *data, uint16_t length);
+
+/* Forward a hub write of chr to every node that has it. Returns how many
+ * nodes took the write, or the first error when none did.
+ */
+int profile_route_write(enum link_chr chr, const void *buf, uint16_t len);
+
+/* Stop handing out values no node refreshed for CONFIG_RELAY_SHADOW_TTL_SEC
+ * to hubs that subscribe.
+ */
+void profile_shadow_expire(void);
+
+#endif /* PROFILE_H_ */
@@ -0,0 +1,505 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/bitarray.h>
+#include <zephyr/sys/slist.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include <string.h>
+
+#include "link.h"
+#include "profile.h"
+#include "proxy.h"
+#include "relay_svc.h"
+#include "tx_sched.h"
+
+/* Properties the proxy can serve; indications from a node are relayed
+ * upstream as notifications.
+ */
+#define PROXY_PROPS (BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | \
+		     BT_GATT_CHRC_WRITE_WITHOUT_RESP | BT_GATT_CHRC_NOTIFY)
+
+/* Attribute types of the mirrored services. The attributes are built at
+ * runtime and outlive the function building them, so their UUIDs need
+ * static storage rather than BT_UUID_DECLARE_16() compound literals.
+ */
+static const struct bt_uuid_16 uuid_primary = BT_UUID_INIT_16(BT_UUID_GATT_PRIMARY_VAL);
+static const struct bt_uuid_16 uuid_chrc = BT_UUID_INIT_16(BT_UUID_GATT_CHRC_VAL);
+static const struct bt_uuid_16 uuid_ccc = BT_UUID_INIT_16(BT_UUID_GATT_CCC_VAL);
+
+/* Services of a node that are not mirrored: the ones the relay serves
+ * itself, from the profile table or as a relay of a chain.
+ */
+static const struct bt_uuid_16 uuid_gap = BT_UUID_INIT_16(BT_UUID_GAP_VAL);
+static const struct bt_uuid_16 uuid_gatt = BT_UUID_INIT_16(BT_UUID_GATT_VAL);
+static const struct bt_uuid_128 uuid_relay = BT_UUID_INIT_128(RELAY_UUID_VAL(0x0001));
+static const struct bt_uuid_128 uuid_diag = BT_UUID_INIT_128(RELAY_UUID_VAL(0x0010));
+
+union proxy_uuid {
+	struct bt_uuid uuid;
+	struct bt_uuid_16 u16;
+	struct bt_uuid_32 u32;
+	struct bt_uuid_128 u128;
+};
+
+struct proxy_node;
+
+/* One row of the handle-translation table: a mirrored characteristic,
+ * its local value attribute and the handle it has on the node.
+ */
+struct proxy_chr {
+	sys_snode_t node;
+	struct proxy_node *owner;
+	uint16_t remote_handle;
+	bool subscribed;
+	bool reading;
+	uint16_t sub_value;
+	const struct bt_gatt_attr *attr;
+	union proxy_uuid uuid;
+	struct bt_gatt_chrc chrc;
+	struct _bt_gatt_ccc ccc;
+	struct bt_gatt_subscribe_params sub;
+	struct bt_gatt_discover_params ccc_disc;
+	struct bt_gatt_read_params read;
+	uint8_t len;
+	uint8_t value[CONFIG_RELAY_TX_VALUE_MAX];
+};
+
+struct proxy_svc {
+	struct proxy_node *owner;
+	union proxy_uuid uuid;
+	uint16_t start_handle;
+	uint16_t end_handle;
+	sys_slist_t chrs;
+	size_t attr_off;
+	struct bt_gatt_service svc;
+};
+
+struct proxy_node {
+	struct bt_conn *conn;
+	struct proxy_svc *cur;
+	struct bt_gatt_discover_params disc;
+};
+
+static struct proxy_node nodes[CONFIG_RELAY_MAX_NODES];
+static struct proxy_svc svcs[CONFIG_RELAY_PROXY_SERVICES];
+
+K_MEM_SLAB_DEFINE_STATIC(chr_slab, sizeof(struct proxy_chr), CONFIG_RELAY_PROXY_CHRS, 4);
+
+/* Mirrored services take contiguous runs of attributes from one pool. */
+static struct bt_gatt_attr attr_pool[CONFIG_RELAY_PROXY_ATTRS];
+SYS_BITARRAY_DEFINE_STATIC(attr_bits, CONFIG_RELAY_PROXY_ATTRS);
+
+static void uuid_copy(union proxy_uuid *dst, const struct bt_uuid *src)
+{
+	switch (src->type) {
+	case BT_UUID_TYPE_16:
+		dst->u16 = *BT_UUID_16(src);
+		break;
+	case BT_UUID_TYPE_32:
+		dst->u32 = *BT_UUID_32(src);
+		break;
+	default:
+		dst->u128 = *BT_UUID_128(src);
+		break;
+	}
+}
+
+static uint8_t read_cb(struct bt_conn *conn, uint8_t err,
+		       struct bt_gatt_read_params *params,
+		       const void *data, uint16_t length)
+{
+	struct proxy_chr *chr = CONTAINER_OF(params, struct proxy_chr, read);
+
+	if (!err && data) {
+		chr->len = MIN(length, sizeof(chr->value));
+		memcpy(chr->value, data, chr->len);
+	}
+	chr->reading = false;
+
+	return BT_GATT_ITER_STOP;
+}
+
+static void refresh(struct proxy_chr *chr)
+{
+	if (!(chr->chrc.properties & BT_GATT_CHRC_READ) || chr->reading) {
+		return;
+	}
+
+	chr->read.func = read_cb;
+	chr->read.handle_count = 1;
+	chr->read.single.handle = chr->remote_handle;
+	chr->read.single.offset = 0;
+
+	chr->reading = !bt_gatt_read(chr->owner->conn, &chr->read);
+}
+
+static ssize_t proxy_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			  void *buf, uint16_t len, uint16_t offset)
+{
+	struct proxy_chr *chr = attr->user_data;
+
+	refresh(chr);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, chr->value, chr->len);
+}
+
+static ssize_t proxy_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			   const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	struct proxy_chr *chr = attr->user_data;
+	int err;
+
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	/* Same kind of write as the hub's, unless the node only takes the
+	 * other one.
+	 */
+	if ((chr->chrc.properties & BT_GATT_CHRC_WRITE_WITHOUT_RESP) &&
+	    (!(chr->chrc.properties & BT_GATT_CHRC_WRITE) || (flags & BT_GATT_WRITE_FLAG_CMD))) {
+		err = tx_sched_write_cmd(chr->owner->conn, chr->remote_handle, buf, len);
+	} else {
+		err = tx_sched_write(chr->owner->conn, chr->remote_handle, buf, len);
+	}
+	if (err == -EMSGSIZE) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	} else if (err) {
+		return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+	}
+
+	return len;
+}
+
+static uint8_t proxy_notify(struct bt_conn *conn,
+			    struct bt_gatt_subscribe_params *params,
+			    const void *data, uint16_t length)
+{
+	struct proxy_chr *chr = CONTAINER_OF(params, struct proxy_chr, sub);
+
+	if (!data) {
+		chr->subscribed = false;
+		return BT_GATT_ITER_STOP;
+	}
+
+	chr->len = MIN(length, sizeof(chr->value));
+	memcpy(chr->value, data, chr->len);
+
+	tx_sched_notify(TX_CLASS_TELEMETRY, chr->attr, chr->value, chr->len);
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+/* Follow the hubs: subscribe on the node while any hub is subscribed to
+ * the mirrored characteristic.
+ */
+static void ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	struct proxy_chr *chr = CONTAINER_OF(attr->user_data, struct proxy_chr, ccc);
+	int err = 0;
+
+	if (value && !chr->subscribed) {
+		chr->sub.notify = proxy_notify;
+		chr->sub.value = chr->sub_value;
+		err = bt_gatt_subscribe(chr->owner->conn, &chr->sub);
+		chr->subscribed = !err;
+	} else if (!value && chr->subscribed) {
+		err = bt_gatt_unsubscribe(chr->owner->conn, &chr->sub);
+		chr->subscribed = false;
+	}
+
+	if (err) {
+		printk("Proxy subscribe failed (err %d)\n", err);
+	}
+}
+
+static size_t chr_attr_count(const struct proxy_chr *chr)
+{
+	return (chr->chrc.properties & BT_GATT_CHRC_NOTIFY) ? 3 : 2;
+}
+
+static int svc_register(struct proxy_svc *svc)
+{
+	struct bt_gatt_attr *attrs;
+	struct proxy_chr *chr;
+	size_t count = 1;
+	size_t n = 0;
+	int err;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&svc->chrs, chr, node) {
+		count += chr_attr_count(chr);
+	}
+
+	err = sys_bitarray_alloc(&attr_bits, count, &svc->attr_off);
+	if (err) {
+		return err;
+	}
+
+	attrs = &attr_pool[svc->attr_off];
+	attrs[n++] = (struct bt_gatt_attr)BT_GATT_ATTRIBUTE(&uuid_primary.uuid,
+		BT_GATT_PERM_READ, bt_gatt_attr_read_service, NULL, &svc->uuid.uuid);
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&svc->chrs, chr, node) {
+		uint8_t perm = 0;
+
+		if (chr->chrc.properties & BT_GATT_CHRC_READ) {
+			perm |= BT_GATT_PERM_READ;
+		}
+		if (chr->chrc.properties & (BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP)) {
+			perm |= BT_GATT_PERM_WRITE;
+		}
+
+		attrs[n++] = (struct bt_gatt_attr)BT_GATT_ATTRIBUTE(&uuid_chrc.uuid,
+			BT_GATT_PERM_READ, bt_gatt_attr_read_chrc, NULL, &chr->chrc);
+
+		chr->attr = &attrs[n];
+		attrs[n++] = (struct bt_gatt_attr)BT_GATT_ATTRIBUTE(&chr->uuid.uuid,
+			perm, proxy_read, proxy_write, chr);
+
+		if (chr->chrc.properties & BT_GATT_CHRC_NOTIFY) {
+			chr->ccc = (struct _bt_gatt_ccc)BT_GATT_CCC_INITIALIZER(ccc_changed,
+										 NULL, NULL);
+			attrs[n++] = (struct bt_gatt_attr)BT_GATT_ATTRIBUTE(&uuid_ccc.uuid,
+				BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+				bt_gatt_attr_read_ccc, bt_gatt_attr_write_ccc, &chr->ccc);
+		}
+	}
+
+	svc->svc.attrs = attrs;
+	svc->svc.attr_count = count;
+
+	err = bt_gatt_service_register(&svc->svc);
+	if (err) {
+		sys_bitarray_free(&attr_bits, count, svc->attr_off);
+		svc->svc.attrs = NULL;
+		return err;
+	}
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&svc->chrs, chr, node) {
+		refresh(chr);
+	}
+
+	return 0;
+}
+
+static void svc_free(struct proxy_svc *svc)
+{
+	sys_snode_t *node;
+
+	if (svc->svc.attrs) {
+		bt_gatt_service_unregister(&svc->svc);
+		sys_bitarray_free(&attr_bits, svc->svc.attr_count, svc->attr_off);
+	}
+
+	while ((node = sys_slist_get(&svc->chrs))) {
+		struct proxy_chr *chr = CONTAINER_OF(node, struct proxy_chr, node);
+
+		if (chr->attr) {
+			tx_sched_purge(chr->attr);
+		}
+		k_mem_slab_free(&chr_slab, (void *)chr);
+	}
+
+	memset(svc, 0, sizeof(*svc));
+}
+
+static void discover_next(struct proxy_node *pn);
+
+static uint8_t discover_chrs(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			     struct bt_gatt_discover_params *params)
+{
+	struct proxy_node *pn = CONTAINER_OF(params, struct proxy_node, disc);
+	struct proxy_svc *svc = pn->cur;
+	const struct bt_gatt_chrc *remote;
+	struct proxy_chr *chr;
+
+	if (pn->conn != conn) {
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (!attr) {
+		int err = svc_register(svc);
+
+		if (err) {
+			printk("Proxy service not mirrored (err %d)\n", err);
+			svc_free(svc);
+		}
+		discover_next(pn);
+		return BT_GATT_ITER_STOP;
+	}
+
+	remote = attr->user_data;
+	if (!(remote->properties & (PROXY_PROPS | BT_GATT_CHRC_INDICATE))) {
+		return BT_GATT_ITER_CONTINUE;
+	}
+
+	if (k_mem_slab_alloc(&chr_slab, (void **)&chr, K_NO_WAIT)) {
+		printk("Proxy characteristic pool exhausted\n");
+		return BT_GATT_ITER_CONTINUE;
+	}
+
+	memset(chr, 0, sizeof(*chr));
+	chr->owner = pn;
+	chr->remote_handle = remote->value_handle;
+	uuid_copy(&chr->uuid, remote->uuid);
+	chr->chrc.uuid = &chr->uuid.uuid;
+	chr->chrc.properties = remote->properties & PROXY_PROPS;
+	if (remote->properties & BT_GATT_CHRC_NOTIFY) {
+		chr->sub_value = BT_GATT_CCC_NOTIFY;
+	} else if (remote->properties & BT_GATT_CHRC_INDICATE) {
+		chr->chrc.properties |= BT_GATT_CHRC_NOTIFY;
+		chr->sub_value = BT_GATT_CCC_INDICATE;
+	}
+
+	/* The node's CCC is found on first subscribe. */
+	chr->sub.value_handle = remote->value_handle;
+	chr->sub.ccc_handle = BT_GATT_AUTO_DISCOVER_CCC_HANDLE;
+	chr->sub.end_handle = svc->end_handle;
+	chr->sub.disc_params = &chr->ccc_disc;
+	atomic_set_bit(chr->sub.flags, BT_GATT_SUBSCRIBE_FLAG_VOLATILE);
+
+	sys_slist_append(&svc->chrs, &chr->node);
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+/* Characterise the next discovered service of this node. */
+static void discover_next(struct proxy_node *pn)
+{
+	int err;
+
+	for (size_t i = 0; i < ARRAY_SIZE(svcs); i++) {
+		struct proxy_svc *svc = &svcs[i];
+
+		if (svc->owner != pn || svc->svc.attrs) {
+			continue;
+		}
+
+		pn->cur = svc;
+		pn->disc.uuid = NULL;
+		pn->disc.func = discover_chrs;
+		pn->disc.start_handle = svc->start_handle;
+		pn->disc.end_handle = svc->end_handle;
+		pn->disc.type = BT_GATT_DISCOVER_CHARACTERISTIC;
+
+		err = bt_gatt_discover(pn->conn, &pn->disc);
+		if (!err) {
+			return;
+		}
+
+		printk("Proxy discover failed (err %d)\n", err);
+		svc_free(svc);
+	}
+
+	pn->cur = NULL;
+	printk("Proxy node %u mirrored\n", (unsigned int)(pn - nodes));
+}
+
+static bool svc_excluded(const struct bt_uuid *uuid)
+{
+	if (!bt_uuid_cmp(uuid, &uuid_gap.uuid) || !bt_uuid_cmp(uuid, &uuid_gatt.uuid) ||
+	    !bt_uuid_cmp(uuid, &uuid_relay.uuid) || !bt_uuid_cmp(uuid, &uuid_diag.uuid)) {
+		return true;
+	}
+
+	if (uuid->type != BT_UUID_TYPE_16) {
+		return false;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(profile_chrs); i++) {
+		if (BT_UUID_16(uuid)->val == profile_chrs[i].svc_uuid) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static uint8_t discover_svcs(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			     struct bt_gatt_discover_params *params)
+{
+	struct proxy_node *pn = CONTAINER_OF(params, struct proxy_node, disc);
+	const struct bt_gatt_service_val *val;
+
+	if (pn->conn != conn) {
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (!attr) {
+		discover_next(pn);
+		return BT_GATT_ITER_STOP;
+	}
+
+	val = attr->user_data;
+	if (svc_excluded(val->uuid)) {
+		return BT_GATT_ITER_CONTINUE;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(svcs); i++) {
+		struct proxy_svc *svc = &svcs[i];
+
+		if (!svc->owner) {
+			svc->owner = pn;
+			uuid_copy(&svc->uuid, val->uuid);
+			svc->start_handle = attr->handle;
+			svc->end_handle = val->end_handle;
+			sys_slist_init(&svc->chrs);
+			return BT_GATT_ITER_CONTINUE;
+		}
+	}
+
+	printk("Proxy service pool exhausted\n");
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct relay_link *link = link_get(conn);
+	struct proxy_node *pn;
+
+	if (err || !link) {
+		return;
+	}
+
+	pn = &nodes[link->id];
+	pn->conn = conn;
+	pn->disc.uuid = NULL;
+	pn->disc.func = discover_svcs;
+	pn->disc.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	pn->disc.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+	pn->disc.type = BT_GATT_DISCOVER_PRIMARY;
+
+	if (bt_gatt_discover(conn, &pn->disc)) {
+		printk("Proxy discover failed\n");
+		pn->conn = NULL;
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(nodes); i++) {
+		struct proxy_node *pn = &nodes[i];
+
+		if (pn->conn != conn) {
+			continue;
+		}
+
+		for (size_t j = 0; j < ARRAY_SIZE(svcs); j++) {
+			if (svcs[j].owner == pn) {
+				svc_free(&svcs[j]);
+			}
+		}
+
+		pn->conn = NULL;
+		pn->cur = NULL;
+	}
+}
+
+BT_CONN_CB_DEFINE(proxy_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
@@ -0,0 +1,21 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef PROXY_H_
+#define PROXY_H_
+
+/* Generic GATT proxy (CONFIG_RELAY_PROXY).
+ *
+ * Every primary service a node exposes, other than GAP and GATT, is
+ * discovered after connection and registered locally as a mirrored
+ * service. Reads return the last value seen from the node and refresh it
+ * in the background, writes are forwarded through the TX scheduler, and
+ * enabling notifications on a mirrored characteristic subscribes to it on
+ * the node. Mirrored services are removed when the node disconnects.
+ *
+ * The proxy hooks connection callbacks itself and needs no calls from
+ * the application.
+ */
+
+#endif /* PROXY_H_ */
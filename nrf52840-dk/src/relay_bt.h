@@ -0,0 +1,87 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef RELAY_BT_H_
+#define RELAY_BT_H_
+
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+/* Stack calls made on the relay data path and by the profile's discovery
+ * and subscriptions. They map straight to the host API, except with
+ * CONFIG_RELAY_BT_MOCK where the benchmark (bench.c) or a test provides
+ * versions that complete without a radio, so the relay logic can be timed
+ * and tested on native_sim.
+ */
+#if defined(CONFIG_RELAY_BT_MOCK)
+struct bt_conn *relay_bt_conn_ref(struct bt_conn *conn);
+void relay_bt_conn_unref(struct bt_conn *conn);
+int relay_bt_notify(struct bt_conn *conn, struct bt_gatt_notify_params *params);
+bool relay_bt_is_subscribed(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			    uint16_t ccc_type);
+int relay_bt_write(struct bt_conn *conn, struct bt_gatt_write_params *params);
+int relay_bt_write_cmd(struct bt_conn *conn, uint16_t handle, const void *data, uint16_t len);
+int relay_bt_discover(struct bt_conn *conn, struct bt_gatt_discover_params *params);
+int relay_bt_subscribe(struct bt_conn *conn, struct bt_gatt_subscribe_params *params);
+int relay_bt_resubscribe(struct bt_conn *conn, struct bt_gatt_subscribe_params *params);
+int relay_bt_read(struct bt_conn *conn, struct bt_gatt_read_params *params);
+#else
+static inline struct bt_conn *relay_bt_conn_ref(struct bt_conn *conn)
+{
+	return bt_conn_ref(conn);
+}
+
+static inline void relay_bt_conn_unref(struct bt_conn *conn)
+{
+	bt_conn_unref(conn);
+}
+
+static inline int relay_bt_notify(struct bt_conn *conn, struct bt_gatt_notify_params *params)
+{
+	return bt_gatt_notify_cb(conn, params);
+}
+
+static inline bool relay_bt_is_subscribed(struct bt_conn *conn,
+					  const struct bt_gatt_attr *attr, uint16_t ccc_type)
+{
+	return bt_gatt_is_subscribed(conn, attr, ccc_type);
+}
+
+static inline int relay_bt_write(struct bt_conn *conn, struct bt_gatt_write_params *params)
+{
+	return bt_gatt_write(conn, params);
+}
+
+static inline int relay_bt_write_cmd(struct bt_conn *conn, uint16_t handle,
+				     const void *data, uint16_t len)
+{
+	return bt_gatt_write_without_response(conn, handle, data, len, false);
+}
+
+static inline int relay_bt_discover(struct bt_conn *conn,
+				    struct bt_gatt_discover_params *params)
+{
+	return bt_gatt_discover(conn, params);
+}
+
+static inline int relay_bt_subscribe(struct bt_conn *conn,
+				     struct bt_gatt_subscribe_params *params)
+{
+	return bt_gatt_subscribe(conn, params);
+}
+
+/* Subscription the bonded peer kept: registered locally, no CCC write. */
+static inline int relay_bt_resubscribe(struct bt_conn *conn,
+				       struct bt_gatt_subscribe_params *params)
+{
+	return bt_gatt_resubscribe(BT_ID_DEFAULT, bt_conn_get_dst(conn), params);
+}
+
+static inline int relay_bt_read(struct bt_conn *conn, struct bt_gatt_read_params *params)
+{
+	return bt_gatt_read(conn, params);
+}
+#endif
+
+#endif /* RELAY_BT_H_ */
@@ -0,0 +1,179 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include <string.h>
+
+#include "relay_svc.h"
+#include "scatter.h"
+#include "tx_sched.h"
+#include "upstream.h"
+#include "wire.h"
+
+/* Wire format of the hub config characteristic. */
+struct hub_config {
+	uint8_t classes;
+	uint16_t min_interval_ms;
+} __packed;
+
+static ssize_t read_hub_config(struct bt_conn *conn,
+			       const struct bt_gatt_attr *attr, void *buf,
+			       uint16_t len, uint16_t offset)
+{
+	struct upstream_filter filter;
+	struct hub_config cfg;
+
+	if (upstream_filter_get(conn, &filter)) {
+		return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+	}
+
+	cfg.classes = filter.classes;
+	cfg.min_interval_ms = sys_cpu_to_le16(filter.min_interval_ms);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &cfg, sizeof(cfg));
+}
+
+static ssize_t write_hub_config(struct bt_conn *conn,
+				const struct bt_gatt_attr *attr, const void *buf,
+				uint16_t len, uint16_t offset, uint8_t flags)
+{
+	const struct hub_config *cfg = buf;
+	struct upstream_filter filter;
+
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (len != sizeof(*cfg)) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	filter.classes = cfg->classes;
+	filter.min_interval_ms = sys_le16_to_cpu(cfg->min_interval_ms);
+
+	if (upstream_filter_set(conn, &filter)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+
+	return len;
+}
+
+static ssize_t write_scatter(struct bt_conn *conn,
+			     const struct bt_gatt_attr *attr, const void *buf,
+			     uint16_t len, uint16_t offset, uint8_t flags)
+{
+	int err;
+
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	err = scatter_submit(conn, attr, buf, len);
+	if (err == -EBUSY) {
+		return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+	} else if (err) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	return len;
+}
+
+BT_GATT_SERVICE_DEFINE(relay_svc,
+	BT_GATT_PRIMARY_SERVICE(RELAY_SERVICE_UUID),
+	BT_GATT_CHARACTERISTIC(RELAY_FRAME_CHAR_UUID,
+			       BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(RELAY_HUB_CONFIG_CHAR_UUID,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+			       read_hub_config, write_hub_config, NULL),
+	BT_GATT_CHARACTERISTIC(RELAY_SCATTER_CHAR_UUID,
+			       BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_WRITE, NULL, write_scatter, NULL),
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+);
+
+uint8_t relay_origin_id(void)
+{
+	static uint8_t origin = CONFIG_RELAY_ORIGIN_ID;
+	bt_addr_le_t addr;
+	size_t count = 1;
+
+	/* Default to the low byte of the identity address. */
+	if (!origin) {
+		bt_id_get(&addr, &count);
+		origin = count ? addr.a.val[0] : 0;
+	}
+
+	return origin;
+}
+
+static int frame_emit(struct relay_link *link, const uint8_t *buf, uint16_t len)
+{
+	const struct relay_frame_hdr *hdr = (const struct relay_frame_hdr *)buf;
+	int err;
+
+	link_stat_inc(link, LINK_STAT_TX);
+
+	/* A wired hub gets every frame, unfiltered and uncoalesced. */
+	wire_send(WIRE_REC_SHADOW, buf, len);
+
+	err = tx_sched_notify_key(profile_chrs[hdr->chr].cls, &relay_svc.attrs[1],
+				  (hdr->origin << 16) | (hdr->node << 8) | hdr->chr,
+				  buf, len);
+	if (err) {
+		link_stat_inc(link, err == -ENOMEM ? LINK_STAT_NO_BUF : LINK_STAT_TX_FAIL);
+	}
+
+	return err < 0 ? err : 0;
+}
+
+int relay_frame_send(struct relay_link *link, enum link_chr chr,
+		     const void *data, uint16_t len)
+{
+	uint8_t buf[CONFIG_RELAY_TX_VALUE_MAX];
+	struct relay_frame_hdr *hdr = (struct relay_frame_hdr *)buf;
+
+	if (len > sizeof(buf) - sizeof(*hdr)) {
+		return -EMSGSIZE;
+	}
+
+	/* The sequence number advances even if the frame is dropped below,
+	 * so the hub sees the loss as a gap rather than a quiet node.
+	 */
+	hdr->node = link->id;
+	hdr->chr = chr;
+	hdr->seq = sys_cpu_to_le16(link_tx_seq_next(link));
+	hdr->origin = relay_origin_id();
+	hdr->hops = 0;
+	memcpy(&buf[sizeof(*hdr)], data, len);
+
+	return frame_emit(link, buf, sizeof(*hdr) + len);
+}
+
+int relay_frame_forward(struct relay_link *link, const struct relay_frame_hdr *hdr,
+			const void *data, uint16_t len)
+{
+	uint8_t buf[CONFIG_RELAY_TX_VALUE_MAX];
+	struct relay_frame_hdr *fwd = (struct relay_frame_hdr *)buf;
+
+	if (hdr->chr >= LINK_CHR_COUNT) {
+		return -EINVAL;
+	}
+
+	if (len > sizeof(buf) - sizeof(*fwd)) {
+		return -EMSGSIZE;
+	}
+
+	*fwd = *hdr;
+	fwd->hops++;
+	memcpy(&buf[sizeof(*fwd)], data, len);
+
+	return frame_emit(link, buf, sizeof(*fwd) + len);
+}
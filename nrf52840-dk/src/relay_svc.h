@@ -0,0 +1,48 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef RELAY_SVC_H_
+#define RELAY_SVC_H_
+
+#include <zephyr/bluetooth/uuid.h>
+
+#include "link.h"
+
+#define RELAY_UUID_VAL(v) \
+	BT_UUID_128_ENCODE(0x8e7f0000 | (v), 0x3c1a, 0x4b6e, 0x9d0f, 0x52c6a1e0b7d4)
+
+#define RELAY_SERVICE_UUID         BT_UUID_DECLARE_128(RELAY_UUID_VAL(0x0001))
+#define RELAY_FRAME_CHAR_UUID      BT_UUID_DECLARE_128(RELAY_UUID_VAL(0x0002))
+#define RELAY_HUB_CONFIG_CHAR_UUID BT_UUID_DECLARE_128(RELAY_UUID_VAL(0x0003))
+#define RELAY_SCATTER_CHAR_UUID    BT_UUID_DECLARE_128(RELAY_UUID_VAL(0x0004))
+#define DIAG_SERVICE_UUID          BT_UUID_DECLARE_128(RELAY_UUID_VAL(0x0010))
+#define DIAG_LINK_STATS_CHAR_UUID  BT_UUID_DECLARE_128(RELAY_UUID_VAL(0x0011))
+
+/* Header of every frame notified on the relay frame characteristic,
+ * followed by the relayed value. node and seq are those given by the
+ * origin relay, where seq counts per node and wraps; hops counts the
+ * relays the frame was forwarded through since.
+ */
+struct relay_frame_hdr {
+	uint8_t node;
+	uint8_t chr;
+	uint16_t seq;
+	uint8_t origin;
+	uint8_t hops;
+} __packed;
+
+/* Id this relay puts in the origin field of its frames. */
+uint8_t relay_origin_id(void);
+
+/* Forward a value received from a node to the hubs as a relay frame. */
+int relay_frame_send(struct relay_link *link, enum link_chr chr,
+		     const void *data, uint16_t len);
+
+/* Forward a frame received from a downstream relay on link, one hop
+ * further.
+ */
+int relay_frame_forward(struct relay_link *link, const struct relay_frame_hdr *hdr,
+			const void *data, uint16_t len);
+
+#endif /* RELAY_SVC_H_ */
@@ -0,0 +1,261 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/settings/settings.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chain.h"
+#include "link.h"
+#include "profile.h"
+#include "resume.h"
+
+#define RESUME_KEY "relay/resume"
+
+/* Handles discovered on a bonded node, persisted so a reconnect can skip
+ * discovery. One entry per bond.
+ */
+struct resume_entry {
+	bt_addr_le_t addr;
+	uint16_t value_handle[LINK_CHR_COUNT];
+	uint16_t ccc_handle[LINK_CHR_COUNT];
+	uint8_t absent;       /* characteristics the node does not have, by bit */
+	/* Relay frame characteristic, zero on a node that is not a relay. */
+	uint16_t chain_value_handle;
+	uint16_t chain_ccc_handle;
+	bool chain_checked;
+};
+
+static struct resume_entry cache[CONFIG_BT_MAX_PAIRED];
+/* Entries changed since the last flush to flash. */
+static ATOMIC_DEFINE(dirty, CONFIG_BT_MAX_PAIRED);
+static struct resume_stats stats[2];
+
+struct bond_match {
+	const bt_addr_le_t *addr;
+	bool found;
+};
+
+static void bond_check(const struct bt_bond_info *info, void *user_data)
+{
+	struct bond_match *match = user_data;
+
+	if (!bt_addr_le_cmp(&info->addr, match->addr)) {
+		match->found = true;
+	}
+}
+
+static bool is_bonded(const bt_addr_le_t *addr)
+{
+	struct bond_match match = { .addr = addr };
+
+	bt_foreach_bond(BT_ID_DEFAULT, bond_check, &match);
+
+	return match.found;
+}
+
+static struct resume_entry *cache_find(const bt_addr_le_t *addr)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(cache); i++) {
+		if (!bt_addr_le_cmp(&cache[i].addr, addr)) {
+			return &cache[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Discovery saves an entry once the profile has settled and again when
+ * the relay frame search ends; write it out with the next flush instead.
+ */
+static void cache_store(struct resume_entry *entry)
+{
+	atomic_set_bit(dirty, entry - cache);
+}
+
+void resume_flush(void)
+{
+	char key[sizeof(RESUME_KEY) + 4];
+
+	for (size_t i = 0; i < ARRAY_SIZE(cache); i++) {
+		if (atomic_test_and_clear_bit(dirty, i)) {
+			snprintf(key, sizeof(key), RESUME_KEY "/%u", (unsigned int)i);
+			settings_save_one(key, &cache[i], sizeof(cache[i]));
+		}
+	}
+}
+
+static void cache_drop(struct resume_entry *entry)
+{
+	char key[sizeof(RESUME_KEY) + 4];
+
+	atomic_clear_bit(dirty, entry - cache);
+
+	snprintf(key, sizeof(key), RESUME_KEY "/%u", (unsigned int)(entry - cache));
+	settings_delete(key);
+
+	memset(entry, 0, sizeof(*entry));
+}
+
+bool resume_start(struct relay_link *link)
+{
+	const bt_addr_le_t *addr = bt_conn_get_dst(link->conn);
+	struct resume_entry *entry = cache_find(addr);
+	int err;
+
+	link->connected_at = k_uptime_get();
+
+	if (!is_bonded(addr)) {
+		if (entry) {
+			cache_drop(entry);
+		}
+
+		/* Bond now, so the next reconnect takes the fast path. */
+		if (IS_ENABLED(CONFIG_RELAY_BOND_NODES)) {
+			err = bt_conn_set_security(link->conn, BT_SECURITY_L2);
+			if (err) {
+				printk("Node %u pairing failed (err %d)\n", link->id, err);
+			}
+		}
+		return false;
+	}
+
+	/* Encryption from the stored LTK; a bonded central never prompts. */
+	err = bt_conn_set_security(link->conn, BT_SECURITY_L2);
+	if (err) {
+		printk("Node %u encryption failed (err %d)\n", link->id, err);
+		return false;
+	}
+
+	if (!entry ||
+	    profile_resume(link, entry->value_handle, entry->ccc_handle, entry->absent)) {
+		return false;
+	}
+
+	link->resumed = true;
+	printk("Node %u resumed from bond\n", link->id);
+
+	/* Only look for relay frames if that was not settled last time. */
+	if (!entry->chain_checked ||
+	    chain_resume(link, entry->chain_value_handle, entry->chain_ccc_handle)) {
+		chain_discover(link);
+	}
+
+	return true;
+}
+
+void resume_save(struct relay_link *link)
+{
+	const bt_addr_le_t *addr = bt_conn_get_dst(link->conn);
+	struct resume_entry cur = { 0 };
+	struct resume_entry *entry;
+
+	/* Half a profile would let the next reconnect skip discovery and
+	 * never subscribe to the rest.
+	 */
+	if (!link_settled(link) ||
+	    bt_conn_get_security(link->conn) < BT_SECURITY_L2 || !is_bonded(addr)) {
+		return;
+	}
+
+	bt_addr_le_copy(&cur.addr, addr);
+	for (int chr = 0; chr < LINK_CHR_COUNT; chr++) {
+		cur.value_handle[chr] = link->subscribe_params[chr].value_handle;
+		cur.ccc_handle[chr] = link->subscribe_params[chr].ccc_handle;
+		if (!cur.value_handle[chr] || !cur.ccc_handle[chr]) {
+			cur.absent |= BIT(chr);
+		}
+	}
+	cur.chain_checked = chain_handles(link, &cur.chain_value_handle, &cur.chain_ccc_handle);
+
+	entry = cache_find(addr);
+
+	/* Reuse the slot of a bond that has since been removed. */
+	for (size_t i = 0; !entry && i < ARRAY_SIZE(cache); i++) {
+		if (!bt_addr_le_cmp(&cache[i].addr, BT_ADDR_LE_ANY) ||
+		    !is_bonded(&cache[i].addr)) {
+			entry = &cache[i];
+		}
+	}
+
+	if (!entry || !memcmp(entry, &cur, sizeof(cur))) {
+		return;
+	}
+
+	*entry = cur;
+	cache_store(entry);
+}
+
+void resume_first_rx(struct relay_link *link)
+{
+	struct resume_stats *s = &stats[link->resumed ? 0 : 1];
+	uint32_t ms = k_uptime_get() - link->connected_at;
+
+	s->count++;
+	s->last_ms = ms;
+	s->total_ms += ms;
+	s->max_ms = MAX(s->max_ms, ms);
+
+	printk("Node %u first notification %u ms after connect (%s, avg %u ms)\n",
+	       link->id, ms, link->resumed ? "bonded" : "fresh", s->total_ms / s->count);
+}
+
+void resume_stats_get(struct resume_stats *bonded, struct resume_stats *fresh)
+{
+	*bonded = stats[0];
+	*fresh = stats[1];
+}
+
+static void security_changed(struct bt_conn *conn, bt_security_t level,
+			     enum bt_security_err err)
+{
+	struct relay_link *link = link_get(conn);
+	struct resume_entry *entry;
+
+	if (!link) {
+		return;
+	}
+
+	if (!err) {
+		resume_save(link);
+		return;
+	}
+
+	printk("Node %u security failed (err %d)\n", link->id, err);
+
+	if (!link->resumed) {
+		return;
+	}
+
+	/* The node lost the bond: forget it and start over with a fresh
+	 * connection, which discovers and subscribes again.
+	 */
+	entry = cache_find(bt_conn_get_dst(conn));
+	if (entry) {
+		cache_drop(entry);
+	}
+	bt_unpair(BT_ID_DEFAULT, bt_conn_get_dst(conn));
+}
+
+BT_CONN_CB_DEFINE(resume_conn_callbacks) = {
+	.security_changed = security_changed,
+};
+
+static int resume_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	unsigned long idx = strtoul(name, NULL, 10);
+
+	if (idx >= ARRAY_SIZE(cache) || len != sizeof(cache[idx])) {
+		return -EINVAL;
+	}
+
+	return read_cb(cb_arg, &cache[idx], sizeof(cache[idx])) < 0 ? -EIO : 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(relay_resume, RESUME_KEY, NULL, resume_set, NULL, NULL);
@@ -0,0 +1,44 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef RESUME_H_
+#define RESUME_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct relay_link;
+
+/* Time from connection to the first relayed notification. */
+struct resume_stats {
+	uint32_t count;
+	uint32_t last_ms;
+	uint32_t total_ms;
+	uint32_t max_ms;
+};
+
+/* Called when a node connects. A bonded node with cached handles gets
+ * encryption started from its stored LTK and its subscriptions restored
+ * without any discovery or CCC write, relying on the CCC state the node
+ * kept for the bond; returns true in that case. That includes the relay
+ * frame subscription of a chained node, and a node known not to be a
+ * relay is not searched again. Otherwise the caller runs discovery.
+ */
+bool resume_start(struct relay_link *link);
+
+/* Store the link's discovered handles once the node is bonded and every
+ * profile characteristic was subscribed or found missing; until then this
+ * does nothing. They reach flash with the next resume_flush().
+ */
+void resume_save(struct relay_link *link);
+
+/* Write the entries saved since the previous flush to settings. */
+void resume_flush(void);
+
+/* Account the first notification relayed from a node. */
+void resume_first_rx(struct relay_link *link);
+
+void resume_stats_get(struct resume_stats *bonded, struct resume_stats *fresh);
+
+#endif /* RESUME_H_ */
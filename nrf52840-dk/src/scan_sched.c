@@ -0,0 +1,360 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <bluetooth/scan.h>
+
+#if defined(CONFIG_RELAY_SCAN_QOS_REPORT)
+#include <zephyr/bluetooth/hci.h>
+#include <sdc_hci_vs.h>
+#endif
+
+#include "link.h"
+#include "scan_sched.h"
+
+/* Scan timing is in 0.625 ms units, connection intervals in 1.25 ms. */
+#define MS_TO_SCAN_UNITS(ms) ((ms) * 8 / 5)
+#define CONN_INTERVAL_US(itv) ((uint32_t)(itv) * 1250)
+#define SCAN_WINDOW_MIN 4
+
+static struct k_spinlock sched_lock;
+static uint16_t cur_interval;
+static uint16_t cur_window;
+static uint16_t cur_load;
+static int64_t duty_since;
+static uint64_t duty_acc;   /* ms * permille since the last stats_get() */
+static int64_t acc_since;
+static int64_t burst_until;
+static uint32_t pauses;
+static atomic_t missed_events;
+
+static void sched_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(sched_work, sched_work_handler);
+
+static uint16_t duty_of(uint16_t interval, uint16_t window)
+{
+	return interval ? window * 1000U / interval : 0;
+}
+
+/* Caller holds sched_lock. */
+static void duty_account(int64_t now)
+{
+	duty_acc += (uint64_t)(now - duty_since) * duty_of(cur_interval, cur_window);
+	duty_since = now;
+}
+
+static void conn_load(struct bt_conn *conn, void *data)
+{
+	uint32_t *load = data;
+	struct bt_conn_info info;
+
+	/* Connections still being established have no interval yet. */
+	if (bt_conn_get_info(conn, &info) || !info.le.interval) {
+		return;
+	}
+
+	*load += CONFIG_RELAY_SCAN_CONN_EVENT_US * 1000U / CONN_INTERVAL_US(info.le.interval);
+}
+
+static uint16_t radio_load(void)
+{
+	uint32_t load = 0;
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, conn_load, &load);
+
+	return MIN(load, 1000);
+}
+
+static void pick(uint16_t load, uint16_t *interval, uint16_t *window)
+{
+	uint32_t duty;
+	size_t nodes = link_count();
+
+	/* Every link slot taken: nothing a scan could connect to. */
+	if (nodes >= CONFIG_RELAY_MAX_NODES) {
+		*interval = 0;
+		*window = 0;
+		return;
+	}
+
+	/* Scan hard while no node is connected at all, back off once some
+	 * are, and give up whatever the connections need in either case.
+	 */
+	if (!nodes) {
+		*interval = MS_TO_SCAN_UNITS(CONFIG_RELAY_SCAN_FAST_INTERVAL_MS);
+		duty = CONFIG_RELAY_SCAN_FAST_DUTY * 10;
+	} else {
+		*interval = MS_TO_SCAN_UNITS(CONFIG_RELAY_SCAN_SPARSE_INTERVAL_MS);
+		duty = CONFIG_RELAY_SCAN_SPARSE_DUTY * 10;
+	}
+
+	duty = MIN(duty, 1000U - load);
+
+	*window = CLAMP(*interval * duty / 1000U, SCAN_WINDOW_MIN, *interval);
+}
+
+static void apply(uint16_t load, uint16_t interval, uint16_t window)
+{
+	struct bt_le_scan_param param = {
+		.type = BT_LE_SCAN_TYPE_PASSIVE,
+		.options = BT_LE_SCAN_OPT_FILTER_DUPLICATE,
+		.interval = interval,
+		.window = window,
+	};
+	bool changed = (interval != cur_interval || window != cur_window);
+	k_spinlock_key_t key;
+	int err = 0;
+
+	if (changed && cur_window) {
+		bt_scan_stop();
+	}
+
+	key = k_spin_lock(&sched_lock);
+	duty_account(k_uptime_get());
+	cur_load = load;
+	if (changed) {
+		cur_interval = interval;
+		cur_window = window;
+	}
+	k_spin_unlock(&sched_lock, key);
+
+	if (!window) {
+		return;
+	}
+
+	if (changed) {
+		bt_scan_params_set(&param);
+	}
+
+	/* The scan module stops scanning while it connects to a node, so
+	 * restart even if the parameters did not change.
+	 */
+	err = bt_scan_start(BT_SCAN_TYPE_SCAN_PASSIVE);
+	if (err && err != -EALREADY) {
+		printk("Scanning failed to start (err %d)\n", err);
+
+		key = k_spin_lock(&sched_lock);
+		duty_account(k_uptime_get());
+		cur_window = 0;
+		k_spin_unlock(&sched_lock, key);
+	}
+}
+
+static void sched_work_handler(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+	uint16_t load = radio_load();
+	uint16_t interval;
+	uint16_t window;
+	k_spinlock_key_t key;
+
+	/* The mesh owns the scanner and scans continuously; the scan module
+	 * only listens in to find nodes.
+	 */
+	if (IS_ENABLED(CONFIG_RELAY_MESH)) {
+		key = k_spin_lock(&sched_lock);
+		duty_account(now);
+		cur_load = load;
+		cur_interval = 1;
+		cur_window = 1;
+		k_spin_unlock(&sched_lock, key);
+		return;
+	}
+
+	if (now < burst_until) {
+		apply(load, 0, 0);
+		k_work_schedule(&sched_work, K_MSEC(burst_until - now));
+		return;
+	}
+
+	pick(load, &interval, &window);
+	apply(load, interval, window);
+}
+
+void scan_sched_update(void)
+{
+	k_work_reschedule(&sched_work, K_NO_WAIT);
+}
+
+void scan_sched_activity(void)
+{
+	int64_t now = k_uptime_get();
+	bool paused = now < burst_until;
+
+	burst_until = now + CONFIG_RELAY_SCAN_BURST_HOLD_MS;
+
+	/* Only the first command of a burst needs the scan stopped; later
+	 * ones just push the resume time out.
+	 */
+	if (!paused && cur_window && !IS_ENABLED(CONFIG_RELAY_MESH)) {
+		pauses++;
+		k_work_reschedule(&sched_work, K_NO_WAIT);
+	}
+}
+
+void scan_sched_stats_get(struct scan_sched_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&sched_lock);
+	int64_t now = k_uptime_get();
+
+	duty_account(now);
+
+	stats->duty_permille = duty_of(cur_interval, cur_window);
+	stats->avg_duty_permille = (now > acc_since) ? duty_acc / (now - acc_since) : 0;
+	stats->load_permille = cur_load;
+	stats->missed_events = atomic_get(&missed_events);
+	stats->pauses = pauses;
+
+	duty_acc = 0;
+	acc_since = now;
+
+	k_spin_unlock(&sched_lock, key);
+}
+
+#if defined(CONFIG_RELAY_SCAN_QOS_REPORT)
+/* Last connection event counter reported per connection handle. A jump of
+ * more than one between two reports is a connection event the controller
+ * had to skip, typically for a scan window or another connection.
+ */
+static struct {
+	uint16_t handle;
+	uint16_t counter;
+	bool valid;
+} qos_conns[CONFIG_BT_MAX_CONN];
+
+static bool qos_evt(struct net_buf_simple *buf)
+{
+	const sdc_hci_subevent_vs_qos_conn_event_report_t *evt;
+	uint16_t gap;
+
+	if (net_buf_simple_pull_u8(buf) != SDC_HCI_SUBEVENT_VS_QOS_CONN_EVENT_REPORT) {
+		return false;
+	}
+
+	evt = (const void *)buf->data;
+
+	for (size_t i = 0; i < ARRAY_SIZE(qos_conns); i++) {
+		if (qos_conns[i].valid && qos_conns[i].handle == evt->conn_handle) {
+			gap = evt->event_counter - qos_conns[i].counter;
+			if (gap > 1) {
+				atomic_add(&missed_events, gap - 1);
+			}
+			qos_conns[i].counter = evt->event_counter;
+			return true;
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(qos_conns); i++) {
+		if (!qos_conns[i].valid) {
+			qos_conns[i].handle = evt->conn_handle;
+			qos_conns[i].counter = evt->event_counter;
+			qos_conns[i].valid = true;
+			break;
+		}
+	}
+
+	return true;
+}
+
+static void qos_forget(struct bt_conn *conn)
+{
+	uint16_t handle;
+
+	if (bt_hci_get_conn_handle(conn, &handle)) {
+		return;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(qos_conns); i++) {
+		if (qos_conns[i].valid && qos_conns[i].handle == handle) {
+			qos_conns[i].valid = false;
+		}
+	}
+}
+
+static int qos_report_enable(void)
+{
+	sdc_hci_cmd_vs_qos_conn_event_report_enable_t *cmd;
+	struct net_buf *buf;
+	int err;
+
+	err = bt_hci_register_vnd_evt_cb(qos_evt);
+	if (err) {
+		return err;
+	}
+
+	buf = bt_hci_cmd_create(SDC_HCI_OPCODE_CMD_VS_QOS_CONN_EVENT_REPORT_ENABLE,
+				sizeof(*cmd));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+
+	cmd = net_buf_add(buf, sizeof(*cmd));
+	cmd->enable = 1;
+
+	return bt_hci_cmd_send_sync(SDC_HCI_OPCODE_CMD_VS_QOS_CONN_EVENT_REPORT_ENABLE,
+				    buf, NULL);
+}
+#else
+static void qos_forget(struct bt_conn *conn)
+{
+}
+
+static int qos_report_enable(void)
+{
+	return 0;
+}
+#endif
+
+void scan_sched_report(void)
+{
+	struct scan_sched_stats stats;
+
+	scan_sched_stats_get(&stats);
+	printk("[SCAN] duty %u.%u%% (now %u.%u%%) load %u.%u%% missed events %u pauses %u\n",
+	       stats.avg_duty_permille / 10, stats.avg_duty_permille % 10,
+	       stats.duty_permille / 10, stats.duty_permille % 10,
+	       stats.load_permille / 10, stats.load_permille % 10,
+	       stats.missed_events, stats.pauses);
+}
+
+void scan_sched_start(void)
+{
+	int err;
+
+	err = qos_report_enable();
+	if (err) {
+		printk("Connection event reports unavailable (err %d)\n", err);
+	}
+
+	duty_since = k_uptime_get();
+	acc_since = duty_since;
+
+	scan_sched_update();
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	scan_sched_update();
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	qos_forget(conn);
+	scan_sched_update();
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	scan_sched_update();
+}
+
+BT_CONN_CB_DEFINE(scan_sched_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_updated = le_param_updated,
+};
@@ -0,0 +1,39 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef SCAN_SCHED_H_
+#define SCAN_SCHED_H_
+
+#include <stdint.h>
+
+struct scan_sched_stats {
+	uint16_t duty_permille;     /* scan window / interval right now */
+	uint16_t avg_duty_permille; /* since the previous stats_get() */
+	uint16_t load_permille;     /* estimated connection event load */
+	uint32_t missed_events;     /* connection events without a packet */
+	uint32_t pauses;            /* scans paused for a command burst */
+};
+
+/* Start scanning for nodes, with parameters picked from the current radio
+ * load and rescheduled as connections come and go.
+ */
+void scan_sched_start(void);
+
+/* Re-evaluate the scan parameters, e.g. after the scan module gave up on a
+ * connection attempt. Also run periodically, to follow load changes no
+ * event reported and restart a scan the scan module stopped.
+ */
+void scan_sched_update(void);
+
+/* A command is about to go to a node: pause scanning until the burst is
+ * over so its connection events are not cut short by scan windows.
+ */
+void scan_sched_activity(void);
+
+void scan_sched_stats_get(struct scan_sched_stats *stats);
+
+/* Print the stats since the previous report or stats_get(). */
+void scan_sched_report(void);
+
+#endif /* SCAN_SCHED_H_ */
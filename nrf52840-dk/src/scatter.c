@@ -0,0 +1,202 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+
+#include <string.h>
+
+#include "link.h"
+#include "relay_bt.h"
+#include "scatter.h"
+#include "tx_sched.h"
+#include "upstream.h"
+
+BUILD_ASSERT(2 + CONFIG_RELAY_SCATTER_MAX_OPS <= CONFIG_RELAY_TX_VALUE_MAX,
+	     "scatter completion does not fit in a relayed value");
+
+struct scatter_batch;
+
+struct scatter_op {
+	struct scatter_batch *batch;
+	uint8_t status;
+};
+
+struct scatter_batch {
+	struct bt_conn *hub;
+	const struct bt_gatt_attr *attr;
+	uint8_t id;
+	uint8_t count;
+	uint8_t remaining; /* outstanding writes, plus one while submitting */
+	struct scatter_op ops[CONFIG_RELAY_SCATTER_MAX_OPS];
+};
+
+static struct scatter_batch batches[CONFIG_RELAY_SCATTER_BATCHES];
+static struct k_spinlock scatter_lock;
+
+static void batch_complete(struct scatter_batch *batch)
+{
+	uint8_t buf[2 + CONFIG_RELAY_SCATTER_MAX_OPS];
+
+	buf[0] = batch->id;
+	buf[1] = batch->count;
+	for (uint8_t i = 0; i < batch->count; i++) {
+		buf[2 + i] = batch->ops[i].status;
+	}
+
+	if (relay_bt_is_subscribed(batch->hub, batch->attr, BT_GATT_CCC_NOTIFY)) {
+		upstream_send_to(batch->hub, TX_CLASS_CONTROL, batch->attr, batch->id,
+				 buf, 2 + batch->count);
+	}
+
+	relay_bt_conn_unref(batch->hub);
+	batch->hub = NULL;
+}
+
+/* Account for one finished node write, or with op NULL for the end of
+ * submission. A later success never overrides an error already recorded
+ * for the operation.
+ */
+static void batch_put(struct scatter_batch *batch, struct scatter_op *op, uint8_t status)
+{
+	k_spinlock_key_t key = k_spin_lock(&scatter_lock);
+	bool done;
+
+	if (op && status && !op->status) {
+		op->status = status;
+	}
+	done = (--batch->remaining == 0);
+
+	k_spin_unlock(&scatter_lock, key);
+
+	if (done) {
+		batch_complete(batch);
+	}
+}
+
+static void write_cb(int err, void *user_data)
+{
+	struct scatter_op *op = user_data;
+	uint8_t status = SCATTER_STATUS_OK;
+
+	if (err > 0) {
+		status = err;
+	} else if (err < 0) {
+		status = SCATTER_STATUS_QUEUE_FULL;
+	}
+
+	batch_put(op->batch, op, status);
+}
+
+static struct scatter_batch *batch_alloc(struct bt_conn *hub)
+{
+	k_spinlock_key_t key = k_spin_lock(&scatter_lock);
+	struct scatter_batch *batch = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(batches); i++) {
+		if (!batches[i].hub) {
+			batch = &batches[i];
+			batch->hub = relay_bt_conn_ref(hub);
+			break;
+		}
+	}
+
+	k_spin_unlock(&scatter_lock, key);
+
+	return batch;
+}
+
+/* Check the framing of the whole write before anything is queued. */
+static int count_ops(const uint8_t *buf, uint16_t len)
+{
+	uint16_t pos = 1;
+	int count = 0;
+
+	while (pos < len) {
+		if (len - pos < 3 || buf[pos + 2] > CONFIG_RELAY_TX_VALUE_MAX ||
+		    len - pos - 3 < buf[pos + 2]) {
+			return -EINVAL;
+		}
+		pos += 3 + buf[pos + 2];
+		count++;
+	}
+
+	return (count && count <= CONFIG_RELAY_SCATTER_MAX_OPS) ? count : -EINVAL;
+}
+
+static void op_submit(struct scatter_op *op, uint8_t node, uint8_t chr,
+		      const uint8_t *value, uint8_t len)
+{
+	bool found = false;
+
+	if (chr >= LINK_CHR_COUNT) {
+		op->status = SCATTER_STATUS_NO_CHR;
+		return;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		struct relay_link *link = &links[i];
+		uint16_t handle = link_handle(link, chr);
+		k_spinlock_key_t key;
+
+		if (!link->conn || (node != SCATTER_NODE_ALL && node != link->id)) {
+			continue;
+		}
+		found = true;
+
+		if (!handle) {
+			op->status = SCATTER_STATUS_NO_CHR;
+			continue;
+		}
+
+		key = k_spin_lock(&scatter_lock);
+		op->batch->remaining++;
+		k_spin_unlock(&scatter_lock, key);
+
+		if (tx_sched_write_cb(link->conn, handle, value, len, write_cb, op)) {
+			batch_put(op->batch, op, SCATTER_STATUS_QUEUE_FULL);
+		}
+	}
+
+	if (!found) {
+		op->status = SCATTER_STATUS_NO_NODE;
+	}
+}
+
+int scatter_submit(struct bt_conn *hub, const struct bt_gatt_attr *attr,
+		   const uint8_t *buf, uint16_t len)
+{
+	struct scatter_batch *batch;
+	uint16_t pos = 1;
+	int count;
+
+	count = (len > 1) ? count_ops(buf, len) : -EINVAL;
+	if (count < 0) {
+		return count;
+	}
+
+	batch = batch_alloc(hub);
+	if (!batch) {
+		return -EBUSY;
+	}
+
+	batch->attr = attr;
+	batch->id = buf[0];
+	batch->count = count;
+	batch->remaining = 1;
+
+	for (int i = 0; i < count; i++) {
+		struct scatter_op *op = &batch->ops[i];
+
+		op->batch = batch;
+		op->status = SCATTER_STATUS_OK;
+
+		op_submit(op, buf[pos], buf[pos + 1], &buf[pos + 3], buf[pos + 2]);
+		pos += 3 + buf[pos + 2];
+	}
+
+	/* Drop the submit reference; completes now if nothing was queued. */
+	batch_put(batch, NULL, SCATTER_STATUS_OK);
+
+	return 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef SCATTER_H_
+#define SCATTER_H_
+
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+/* A scatter write is a batch id followed by one or more operations:
+ *
+ *   batch_id u8 | { node u8, chr u8, len u8, value[len] } ...
+ *
+ * node is a link id, or SCATTER_NODE_ALL for every connected node; chr is
+ * an enum link_chr. All writes of a batch are queued at once, so writes to
+ * different nodes proceed in parallel. When the last one completes the
+ * issuing hub gets a single notification on the scatter characteristic:
+ *
+ *   batch_id u8 | count u8 | status[count] u8
+ *
+ * where each status is 0, the ATT error returned by the node, or one of
+ * the SCATTER_STATUS_* codes below.
+ */
+#define SCATTER_NODE_ALL 0xff
+
+#define SCATTER_STATUS_OK            0x00
+#define SCATTER_STATUS_NO_NODE       0x80
+#define SCATTER_STATUS_NO_CHR        0x81
+#define SCATTER_STATUS_QUEUE_FULL    0x82
+
+/* Parse and queue a scatter write from a hub; attr is the scatter
+ * characteristic value the completion is notified on. Returns 0, -EINVAL
+ * for a malformed write, or -EBUSY if no batch slot is free.
+ */
+int scatter_submit(struct bt_conn *hub, const struct bt_gatt_attr *attr,
+		   const uint8_t *buf, uint16_t len);
+
+#endif /* SCATTER_H_ */
@@ -0,0 +1,562 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+#include <zephyr/sys/atomic.h>
+
+#include <string.h>
+
+#include "link.h"
+#include "relay_bt.h"
+#include "scan_sched.h"
+#include "tx_sched.h"
+#include "upstream.h"
+
+#define LAT_BUCKET_US 2000
+#define LAT_BUCKETS   128
+
+enum tx_kind {
+	TX_KIND_NOTIFY,
+	TX_KIND_WRITE,
+	TX_KIND_WRITE_CMD,
+};
+
+struct tx_item {
+	sys_snode_t node;
+	uint8_t cls;
+	uint8_t kind;
+	uint16_t len;
+	uint32_t key;
+	uint32_t enq_cyc;
+	const struct bt_gatt_attr *attr;
+	struct bt_conn *conn;
+	struct bt_gatt_write_params write;
+	tx_sched_write_cb_t cb;
+	void *user_data;
+	uint8_t data[CONFIG_RELAY_TX_VALUE_MAX];
+};
+
+K_MEM_SLAB_DEFINE_STATIC(tx_slab, sizeof(struct tx_item), CONFIG_RELAY_TX_QUEUE_SIZE, 4);
+
+static sys_slist_t tx_queue[TX_CLASS_COUNT];
+/* Writes waiting for their response, at most one per node. */
+static sys_slist_t tx_writing;
+static struct k_spinlock tx_lock;
+static atomic_t inflight;
+
+static struct k_spinlock lat_lock;
+static uint32_t lat_hist[LAT_BUCKETS];
+static uint32_t lat_count;
+static uint32_t lat_max_us;
+
+static void tx_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(tx_work, tx_work_handler);
+
+#if defined(CONFIG_RELAY_TX_LOAD_TEST)
+static const struct bt_gatt_attr *load_attr;
+static uint8_t load_data[CONFIG_RELAY_TX_VALUE_MAX];
+static uint16_t load_len;
+#endif
+
+void tx_sched_kick(void)
+{
+	k_work_reschedule(&tx_work, K_NO_WAIT);
+}
+
+static void latency_record(uint32_t enq_cyc)
+{
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - enq_cyc);
+	uint32_t bucket = MIN(us / LAT_BUCKET_US, LAT_BUCKETS - 1);
+	k_spinlock_key_t key = k_spin_lock(&lat_lock);
+
+	lat_hist[bucket]++;
+	lat_count++;
+	lat_max_us = MAX(lat_max_us, us);
+
+	k_spin_unlock(&lat_lock, key);
+}
+
+static uint32_t latency_percentile(uint32_t pct)
+{
+	uint32_t target = DIV_ROUND_UP(lat_count * pct, 100);
+	uint32_t seen = 0;
+
+	for (int i = 0; i < LAT_BUCKETS; i++) {
+		seen += lat_hist[i];
+		if (seen >= target) {
+			return MIN((i + 1) * LAT_BUCKET_US, lat_max_us);
+		}
+	}
+
+	return lat_max_us;
+}
+
+void tx_sched_latency_get(struct tx_sched_latency *lat)
+{
+	k_spinlock_key_t key = k_spin_lock(&lat_lock);
+
+	lat->count = lat_count;
+	lat->p50_us = lat_count ? latency_percentile(50) : 0;
+	lat->p99_us = lat_count ? latency_percentile(99) : 0;
+	lat->max_us = lat_max_us;
+
+	k_spin_unlock(&lat_lock, key);
+}
+
+void tx_sched_latency_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lat_lock);
+
+	memset(lat_hist, 0, sizeof(lat_hist));
+	lat_count = 0;
+	lat_max_us = 0;
+
+	k_spin_unlock(&lat_lock, key);
+}
+
+static struct tx_item *item_alloc(void)
+{
+	void *item;
+
+	if (k_mem_slab_alloc(&tx_slab, &item, K_NO_WAIT)) {
+		return NULL;
+	}
+
+	return item;
+}
+
+static void item_free(struct tx_item *item)
+{
+	if (item->conn) {
+		relay_bt_conn_unref(item->conn);
+	}
+	k_mem_slab_free(&tx_slab, (void *)item);
+}
+
+/* Called with tx_lock held. */
+static bool write_busy(const struct bt_conn *conn)
+{
+	struct tx_item *item;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&tx_writing, item, node) {
+		if (item->conn == conn) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Find the next item to send: strict priority, except that telemetry which
+ * has waited past the aging threshold goes ahead of control traffic. A
+ * write is only eligible while its node has no other write outstanding, so
+ * commands to different nodes go out in parallel; notifications need room
+ * under the in-flight limit. Called with tx_lock held.
+ */
+static struct tx_item *pick(bool room, sys_snode_t **prev_out)
+{
+	const uint32_t age_cyc = k_ms_to_cyc_ceil32(CONFIG_RELAY_TX_TELEMETRY_AGE_MS);
+	sys_snode_t *node;
+	int order[TX_CLASS_COUNT + 1];
+	int n = 0;
+
+	node = sys_slist_peek_head(&tx_queue[TX_CLASS_TELEMETRY]);
+	if (node && room &&
+	    k_cycle_get_32() - CONTAINER_OF(node, struct tx_item, node)->enq_cyc >= age_cyc) {
+		order[n++] = TX_CLASS_TELEMETRY;
+	}
+
+	for (int cls = 0; cls < TX_CLASS_COUNT; cls++) {
+		order[n++] = cls;
+	}
+
+	for (int i = 0; i < n; i++) {
+		sys_snode_t *prev = NULL;
+
+		SYS_SLIST_FOR_EACH_NODE(&tx_queue[order[i]], node) {
+			struct tx_item *item = CONTAINER_OF(node, struct tx_item, node);
+
+			if (item->kind != TX_KIND_NOTIFY ? !write_busy(item->conn) : room) {
+				*prev_out = prev;
+				return item;
+			}
+			prev = node;
+		}
+	}
+
+	return NULL;
+}
+
+static enum tx_class next_class(void)
+{
+	sys_snode_t *prev;
+	k_spinlock_key_t key = k_spin_lock(&tx_lock);
+	struct tx_item *item = pick(true, &prev);
+	enum tx_class cls = item ? item->cls : TX_CLASS_COUNT;
+
+	k_spin_unlock(&tx_lock, key);
+
+	return cls;
+}
+
+static struct tx_item *dequeue(bool room)
+{
+	sys_snode_t *prev;
+	k_spinlock_key_t key = k_spin_lock(&tx_lock);
+	struct tx_item *item = pick(room, &prev);
+
+	if (item) {
+		sys_slist_remove(&tx_queue[item->cls], prev, &item->node);
+	}
+
+	k_spin_unlock(&tx_lock, key);
+
+	return item;
+}
+
+static void requeue_head(struct tx_item *item)
+{
+	k_spinlock_key_t key = k_spin_lock(&tx_lock);
+
+	sys_slist_prepend(&tx_queue[item->cls], &item->node);
+
+	k_spin_unlock(&tx_lock, key);
+}
+
+bool tx_sched_pdu_reserve(void)
+{
+	atomic_val_t cur;
+
+	do {
+		cur = atomic_get(&inflight);
+		if (cur >= CONFIG_RELAY_TX_INFLIGHT_MAX) {
+			return false;
+		}
+	} while (!atomic_cas(&inflight, cur, cur + 1));
+
+	return true;
+}
+
+void tx_sched_pdu_release(void)
+{
+	atomic_dec(&inflight);
+}
+
+void tx_sched_pdu_done(enum tx_class cls, uint32_t enq_cyc)
+{
+	if (cls == TX_CLASS_CONTROL) {
+		latency_record(enq_cyc);
+	}
+
+	atomic_dec(&inflight);
+	tx_sched_kick();
+}
+
+static void write_finish(struct tx_item *item, int err)
+{
+	k_spinlock_key_t key = k_spin_lock(&tx_lock);
+
+	sys_slist_find_and_remove(&tx_writing, &item->node);
+
+	k_spin_unlock(&tx_lock, key);
+
+	if (err) {
+		link_stat_inc_conn(item->conn, LINK_STAT_TX_FAIL);
+	}
+
+	if (item->cb) {
+		item->cb(err, item->user_data);
+	}
+
+	item_free(item);
+	tx_sched_kick();
+}
+
+static bool conn_connected(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+
+	return !bt_conn_get_info(conn, &info) && info.state == BT_CONN_STATE_CONNECTED;
+}
+
+static void write_done(struct bt_conn *conn, uint8_t err,
+		       struct bt_gatt_write_params *params)
+{
+	struct tx_item *item = CONTAINER_OF(params, struct tx_item, write);
+
+	if (err) {
+		printk("Relay write failed (err 0x%02x)\n", err);
+	}
+
+	/* The host fails requests pending on an ATT timeout with this, but
+	 * also those cut short by a disconnect; only the first leaves the
+	 * connection up.
+	 */
+	if (err == BT_ATT_ERR_UNLIKELY && conn_connected(conn)) {
+		link_stat_inc_conn(conn, LINK_STAT_ATT_TIMEOUTS);
+	}
+
+	latency_record(item->enq_cyc);
+	write_finish(item, err);
+}
+
+static int send_item(struct tx_item *item)
+{
+	int err;
+
+	if (item->kind == TX_KIND_WRITE) {
+		k_spinlock_key_t key;
+
+		item->write.func = write_done;
+		item->write.offset = 0;
+		item->write.data = item->data;
+		item->write.length = item->len;
+
+		key = k_spin_lock(&tx_lock);
+		sys_slist_append(&tx_writing, &item->node);
+		k_spin_unlock(&tx_lock, key);
+
+		err = relay_bt_write(item->conn, &item->write);
+		if (err) {
+			key = k_spin_lock(&tx_lock);
+			sys_slist_find_and_remove(&tx_writing, &item->node);
+			k_spin_unlock(&tx_lock, key);
+		}
+		return err;
+	}
+
+	if (item->kind == TX_KIND_WRITE_CMD) {
+		err = relay_bt_write_cmd(item->conn, item->write.handle, item->data, item->len);
+		if (err && err != -ENOMEM) {
+			link_stat_inc_conn(item->conn, LINK_STAT_TX_FAIL);
+		}
+		return err;
+	}
+
+	upstream_notify(item->cls, item->attr, item->key, item->data, item->len, item->enq_cyc);
+
+	return 0;
+}
+
+static void tx_work_handler(struct k_work *work)
+{
+	struct tx_item *item;
+#if defined(CONFIG_RELAY_TX_LOAD_TEST)
+	bool reloaded = false;
+#endif
+	int err;
+
+	for (;;) {
+		bool room = atomic_get(&inflight) < CONFIG_RELAY_TX_INFLIGHT_MAX;
+
+		/* Values parked for a busy hub go before newer queued
+		 * traffic of the same or lower priority.
+		 */
+		if (room && upstream_flush(next_class())) {
+			continue;
+		}
+
+		item = dequeue(room);
+		if (!item) {
+#if defined(CONFIG_RELAY_TX_LOAD_TEST)
+			/* One synthetic sample per pass; each completion
+			 * brings us back here, which keeps the link busy.
+			 */
+			if (room && load_attr && !reloaded) {
+				reloaded = true;
+				tx_sched_notify(TX_CLASS_TELEMETRY, load_attr, load_data, load_len);
+				continue;
+			}
+#endif
+			break;
+		}
+
+		err = send_item(item);
+		if (err == -ENOMEM) {
+			/* Out of TX buffers; retry once one is released. */
+			if (item->kind != TX_KIND_NOTIFY) {
+				link_stat_inc_conn(item->conn, LINK_STAT_NO_BUF);
+			}
+			requeue_head(item);
+			if (atomic_get(&inflight) == 0 && sys_slist_is_empty(&tx_writing)) {
+				k_work_reschedule(&tx_work, K_MSEC(5));
+			}
+			break;
+		}
+
+		if (err) {
+			printk("Relay TX failed (class %u, err %d)\n", item->cls, err);
+		}
+
+		/* A write stays allocated until its response arrives. */
+		if (item->kind != TX_KIND_WRITE) {
+			item_free(item);
+		} else if (err) {
+			write_finish(item, err);
+		}
+	}
+}
+
+int tx_sched_notify_key(enum tx_class cls, const struct bt_gatt_attr *attr,
+			uint32_t key, const void *data, uint16_t len)
+{
+	struct tx_item *item;
+	sys_snode_t *node;
+	k_spinlock_key_t lock_key;
+
+	if (len > CONFIG_RELAY_TX_VALUE_MAX) {
+		return -EMSGSIZE;
+	}
+
+#if defined(CONFIG_RELAY_TX_LOAD_TEST)
+	if (cls == TX_CLASS_TELEMETRY && key == 0) {
+		load_attr = attr;
+		memcpy(load_data, data, len);
+		load_len = len;
+	}
+#endif
+
+	if (cls != TX_CLASS_CONTROL) {
+		lock_key = k_spin_lock(&tx_lock);
+		SYS_SLIST_FOR_EACH_NODE(&tx_queue[cls], node) {
+			item = CONTAINER_OF(node, struct tx_item, node);
+			if (item->attr == attr && item->key == key) {
+				memcpy(item->data, data, len);
+				item->len = len;
+				k_spin_unlock(&tx_lock, lock_key);
+				return 1;
+			}
+		}
+		k_spin_unlock(&tx_lock, lock_key);
+	}
+
+	item = item_alloc();
+	if (!item) {
+		return -ENOMEM;
+	}
+
+	item->cls = cls;
+	item->kind = TX_KIND_NOTIFY;
+	item->attr = attr;
+	item->conn = NULL;
+	item->len = len;
+	item->key = key;
+	item->enq_cyc = k_cycle_get_32();
+	memcpy(item->data, data, len);
+
+	lock_key = k_spin_lock(&tx_lock);
+	sys_slist_append(&tx_queue[cls], &item->node);
+	k_spin_unlock(&tx_lock, lock_key);
+
+	tx_sched_kick();
+
+	return 0;
+}
+
+static int write_queue(enum tx_kind kind, struct bt_conn *conn, uint16_t handle,
+		       const void *data, uint16_t len,
+		       tx_sched_write_cb_t cb, void *user_data)
+{
+	struct tx_item *item;
+	k_spinlock_key_t key;
+
+	if (!conn) {
+		return -ENOTCONN;
+	}
+
+	if (len > CONFIG_RELAY_TX_VALUE_MAX) {
+		return -EMSGSIZE;
+	}
+
+	item = item_alloc();
+	if (!item) {
+		link_stat_inc_conn(conn, LINK_STAT_NO_BUF);
+		return -ENOMEM;
+	}
+
+	link_stat_inc_conn(conn, LINK_STAT_WRITES);
+
+	item->cls = TX_CLASS_CONTROL;
+	item->kind = kind;
+	item->attr = NULL;
+	item->conn = relay_bt_conn_ref(conn);
+	item->len = len;
+	item->enq_cyc = k_cycle_get_32();
+	item->write.handle = handle;
+	item->cb = cb;
+	item->user_data = user_data;
+	memcpy(item->data, data, len);
+
+	key = k_spin_lock(&tx_lock);
+	sys_slist_append(&tx_queue[TX_CLASS_CONTROL], &item->node);
+	k_spin_unlock(&tx_lock, key);
+
+	scan_sched_activity();
+	tx_sched_kick();
+
+	return 0;
+}
+
+int tx_sched_write_cb(struct bt_conn *conn, uint16_t handle,
+		      const void *data, uint16_t len,
+		      tx_sched_write_cb_t cb, void *user_data)
+{
+	return write_queue(TX_KIND_WRITE, conn, handle, data, len, cb, user_data);
+}
+
+int tx_sched_write_cmd(struct bt_conn *conn, uint16_t handle,
+		       const void *data, uint16_t len)
+{
+	return write_queue(TX_KIND_WRITE_CMD, conn, handle, data, len, NULL, NULL);
+}
+
+void tx_sched_purge(const struct bt_gatt_attr *attr)
+{
+	sys_slist_t drop;
+	sys_snode_t *node;
+	k_spinlock_key_t key = k_spin_lock(&tx_lock);
+
+	sys_slist_init(&drop);
+
+	for (int cls = 0; cls < TX_CLASS_COUNT; cls++) {
+		sys_snode_t *prev = NULL;
+		sys_snode_t *next;
+
+		SYS_SLIST_FOR_EACH_NODE_SAFE(&tx_queue[cls], node, next) {
+			if (CONTAINER_OF(node, struct tx_item, node)->attr == attr) {
+				sys_slist_remove(&tx_queue[cls], prev, node);
+				sys_slist_append(&drop, node);
+			} else {
+				prev = node;
+			}
+		}
+	}
+
+#if defined(CONFIG_RELAY_TX_LOAD_TEST)
+	if (load_attr == attr) {
+		load_attr = NULL;
+	}
+#endif
+
+	k_spin_unlock(&tx_lock, key);
+
+	while ((node = sys_slist_get(&drop))) {
+		item_free(CONTAINER_OF(node, struct tx_item, node));
+	}
+
+	upstream_purge(NULL, attr);
+}
+
+#if defined(CONFIG_RELAY_TX_LOAD_TEST)
+void tx_sched_load_report(void)
+{
+	struct tx_sched_latency lat;
+
+	tx_sched_latency_get(&lat);
+	printk("[TX LOAD] commands %u p50 %u us p99 %u us max %u us\n",
+	       lat.count, lat.p50_us, lat.p99_us, lat.max_us);
+	tx_sched_latency_reset();
+}
+#endif
@@ -0,0 +1,91 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef TX_SCHED_H_
+#define TX_SCHED_H_
+
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+/* Traffic classes, highest priority first. */
+enum tx_class {
+	TX_CLASS_CONTROL,
+	TX_CLASS_TELEMETRY,
+	TX_CLASS_DIAG,
+
+	TX_CLASS_COUNT
+};
+
+struct tx_sched_latency {
+	uint32_t count;
+	uint32_t p50_us;
+	uint32_t p99_us;
+	uint32_t max_us;
+};
+
+/* Queue a notification of attr to every subscribed peripheral-role peer.
+ * Telemetry and diagnostics are coalesced per attribute and key; only the
+ * latest value is kept while one is pending. Returns 1 if a pending value
+ * was superseded.
+ */
+int tx_sched_notify_key(enum tx_class cls, const struct bt_gatt_attr *attr,
+			uint32_t key, const void *data, uint16_t len);
+
+static inline int tx_sched_notify(enum tx_class cls, const struct bt_gatt_attr *attr,
+				  const void *data, uint16_t len)
+{
+	return tx_sched_notify_key(cls, attr, 0, data, len);
+}
+
+/* Completion of a queued write: 0, an ATT error from the node, or a
+ * negative error if the write could not be sent.
+ */
+typedef void (*tx_sched_write_cb_t)(int err, void *user_data);
+
+/* Queue a control write to a downstream node. Writes to one node go out
+ * one at a time; writes to different nodes are sent in parallel.
+ */
+int tx_sched_write_cb(struct bt_conn *conn, uint16_t handle,
+		      const void *data, uint16_t len,
+		      tx_sched_write_cb_t cb, void *user_data);
+
+static inline int tx_sched_write(struct bt_conn *conn, uint16_t handle,
+				 const void *data, uint16_t len)
+{
+	return tx_sched_write_cb(conn, handle, data, len, NULL, NULL);
+}
+
+/* Queue a Write Command (write without response) to a downstream node. It
+ * keeps its place among the node's writes but has no completion.
+ */
+int tx_sched_write_cmd(struct bt_conn *conn, uint16_t handle,
+		       const void *data, uint16_t len);
+
+/* Drop every queued or parked notification of attr, before the attribute
+ * goes away.
+ */
+void tx_sched_purge(const struct bt_gatt_attr *attr);
+
+/* Run the scheduler, e.g. after a parked value became due. */
+void tx_sched_kick(void);
+
+/* In-flight accounting for PDUs handed to the host outside the queue.
+ * reserve() fails once the in-flight limit is reached; every successful
+ * reserve is balanced by release() if the send failed, or by done() from
+ * the completion callback.
+ */
+bool tx_sched_pdu_reserve(void);
+void tx_sched_pdu_release(void);
+void tx_sched_pdu_done(enum tx_class cls, uint32_t enq_cyc);
+
+/* Latency of control PDUs from enqueue to completion. */
+void tx_sched_latency_get(struct tx_sched_latency *lat);
+void tx_sched_latency_reset(void);
+
+#if defined(CONFIG_RELAY_TX_LOAD_TEST)
+/* Print and reset the control latency percentiles. */
+void tx_sched_load_report(void);
+#endif
+
+#endif /* TX_SCHED_H_ */
@@ -0,0 +1,449 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#include <string.h>
+
+#include "relay_bt.h"
+#include "upstream.h"
+
+#define FILTER_ALL_CLASSES (BIT(TX_CLASS_COUNT) - 1)
+
+struct upstream_slot {
+	const struct bt_gatt_attr *attr;
+	uint32_t key;
+	uint8_t cls;
+	uint8_t len;
+	uint32_t enq_cyc;
+	uint8_t data[CONFIG_RELAY_TX_VALUE_MAX];
+};
+
+/* Notifications complete in order on a connection, so a FIFO of what was
+ * sent is enough to account for each completion.
+ */
+struct upstream_sent {
+	uint8_t cls;
+	uint32_t enq_cyc;
+};
+
+struct upstream_client {
+	struct bt_conn *conn;
+	uint8_t gen;            /* bumped on attach, tags completions */
+	struct upstream_filter filter;
+	int64_t last_telemetry;
+	struct k_work_delayable rate_work;
+	struct upstream_slot pending[CONFIG_RELAY_UPSTREAM_PENDING];
+	struct upstream_sent sent[CONFIG_RELAY_UPSTREAM_BUDGET];
+	uint8_t sent_head;
+	uint8_t inflight;
+	uint32_t drops;
+};
+
+/* Client state is touched from the BT RX thread (CCC writes, connection
+ * callbacks) and the system workqueue (TX scheduler, notify completions).
+ * The mutex is recursive, so completions the stack runs from inside a
+ * send do not deadlock.
+ */
+static K_MUTEX_DEFINE(clients_lock);
+static struct upstream_client clients[CONFIG_RELAY_MAX_HUBS];
+static uint8_t flush_next;
+
+/* Completion tag: slot index and the generation it was sent under. */
+#define SENT_TAG(_client) \
+	((void *)(uintptr_t)(((_client)->gen << 8) | ((_client) - clients)))
+
+static struct upstream_client *client_get(const struct bt_conn *conn)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		if (conn && clients[i].conn == conn) {
+			return &clients[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void rate_work_handler(struct k_work *work)
+{
+	tx_sched_kick();
+}
+
+static bool rate_limited(struct upstream_client *client, enum tx_class cls)
+{
+	int64_t due;
+
+	if (cls != TX_CLASS_TELEMETRY || !client->filter.min_interval_ms) {
+		return false;
+	}
+
+	due = client->last_telemetry + client->filter.min_interval_ms;
+	if (k_uptime_get() >= due) {
+		return false;
+	}
+
+	k_work_schedule(&client->rate_work, K_MSEC(due - k_uptime_get()));
+
+	return true;
+}
+
+static void park(struct upstream_client *client, enum tx_class cls,
+		 const struct bt_gatt_attr *attr, uint32_t key,
+		 const void *data, uint16_t len, uint32_t enq_cyc)
+{
+	struct upstream_slot *free_slot = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(client->pending); i++) {
+		struct upstream_slot *slot = &client->pending[i];
+
+		if (slot->attr == attr && slot->key == key) {
+			/* Superseded: keep the original timestamp so aging
+			 * and latency still count from the first value.
+			 */
+			memcpy(slot->data, data, len);
+			slot->len = len;
+			slot->cls = MIN(slot->cls, cls);
+			return;
+		}
+
+		if (!slot->attr && !free_slot) {
+			free_slot = slot;
+		}
+	}
+
+	if (!free_slot) {
+		client->drops++;
+		return;
+	}
+
+	free_slot->attr = attr;
+	free_slot->key = key;
+	free_slot->cls = cls;
+	free_slot->len = len;
+	free_slot->enq_cyc = enq_cyc;
+	memcpy(free_slot->data, data, len);
+}
+
+/* The only place budget comes back: the stack calls this once for every
+ * notification it accepted, also for those flushed on disconnect. A slot
+ * is not reused until all of them have come back, and the generation
+ * keeps a late completion off a slot that was reused anyway.
+ */
+static void notify_done(struct bt_conn *conn, void *user_data)
+{
+	uintptr_t tag = (uintptr_t)user_data;
+	struct upstream_client *client = &clients[tag & 0xff];
+	struct upstream_sent sent;
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+
+	if (client->gen != (uint8_t)(tag >> 8) || !client->inflight) {
+		k_mutex_unlock(&clients_lock);
+		return;
+	}
+
+	sent = client->sent[client->sent_head];
+	client->sent_head = (client->sent_head + 1) % ARRAY_SIZE(client->sent);
+	client->inflight--;
+
+	k_mutex_unlock(&clients_lock);
+
+	tx_sched_pdu_done(sent.cls, sent.enq_cyc);
+}
+
+static int send_to(struct upstream_client *client, enum tx_class cls,
+		   const struct bt_gatt_attr *attr, const void *data,
+		   uint16_t len, uint32_t enq_cyc)
+{
+	struct bt_gatt_notify_params params = {
+		.attr = attr,
+		.data = data,
+		.len = len,
+		.func = notify_done,
+		.user_data = SENT_TAG(client),
+	};
+	struct upstream_sent *sent;
+	int err;
+
+	if (client->inflight >= CONFIG_RELAY_UPSTREAM_BUDGET ||
+	    rate_limited(client, cls) || !tx_sched_pdu_reserve()) {
+		return -EAGAIN;
+	}
+
+	err = relay_bt_notify(client->conn, &params);
+	if (err) {
+		tx_sched_pdu_release();
+		return err;
+	}
+
+	sent = &client->sent[(client->sent_head + client->inflight) % ARRAY_SIZE(client->sent)];
+	sent->cls = cls;
+	sent->enq_cyc = enq_cyc;
+	client->inflight++;
+
+	if (cls == TX_CLASS_TELEMETRY) {
+		client->last_telemetry = k_uptime_get();
+	}
+
+	return 0;
+}
+
+void upstream_notify(enum tx_class cls, const struct bt_gatt_attr *attr, uint32_t key,
+		     const void *data, uint16_t len, uint32_t enq_cyc)
+{
+	k_mutex_lock(&clients_lock, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		struct upstream_client *client = &clients[i];
+		int err;
+
+		if (!client->conn || !(client->filter.classes & BIT(cls)) ||
+		    !relay_bt_is_subscribed(client->conn, attr, BT_GATT_CCC_NOTIFY)) {
+			continue;
+		}
+
+		err = send_to(client, cls, attr, data, len, enq_cyc);
+		if (err == -EAGAIN || err == -ENOMEM) {
+			park(client, cls, attr, key, data, len, enq_cyc);
+		} else if (err) {
+			client->drops++;
+		}
+	}
+
+	k_mutex_unlock(&clients_lock);
+}
+
+static struct upstream_slot *best_slot(struct upstream_client *client, enum tx_class max_cls)
+{
+	struct upstream_slot *best = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(client->pending); i++) {
+		struct upstream_slot *slot = &client->pending[i];
+
+		if (slot->attr && slot->cls <= max_cls &&
+		    (!best || slot->cls < best->cls ||
+		     (slot->cls == best->cls &&
+		      (int32_t)(slot->enq_cyc - best->enq_cyc) < 0))) {
+			best = slot;
+		}
+	}
+
+	return best;
+}
+
+int upstream_flush(enum tx_class max_cls)
+{
+	int sent = 0;
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+
+	/* Round-robin over hubs so a slow one is never served first twice. */
+	for (size_t n = 0; n < ARRAY_SIZE(clients); n++) {
+		struct upstream_client *client = &clients[(flush_next + n) % ARRAY_SIZE(clients)];
+		struct upstream_slot *slot;
+		int err;
+
+		if (!client->conn || client->inflight >= CONFIG_RELAY_UPSTREAM_BUDGET) {
+			continue;
+		}
+
+		slot = best_slot(client, max_cls);
+		if (!slot) {
+			continue;
+		}
+
+		err = send_to(client, slot->cls, slot->attr, slot->data, slot->len, slot->enq_cyc);
+		if (err == -EAGAIN || err == -ENOMEM) {
+			continue;
+		}
+
+		if (err) {
+			client->drops++;
+		}
+		slot->attr = NULL;
+
+		if (!err) {
+			flush_next = (flush_next + n + 1) % ARRAY_SIZE(clients);
+			sent = 1;
+			break;
+		}
+	}
+
+	k_mutex_unlock(&clients_lock);
+
+	return sent;
+}
+
+void upstream_send_to(struct bt_conn *conn, enum tx_class cls, const struct bt_gatt_attr *attr,
+		      uint32_t key, const void *data, uint16_t len)
+{
+	struct upstream_client *client;
+
+	if (len > CONFIG_RELAY_TX_VALUE_MAX) {
+		return;
+	}
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+
+	client = client_get(conn);
+	if (client) {
+		park(client, cls, attr, key, data, len, k_cycle_get_32());
+	}
+
+	k_mutex_unlock(&clients_lock);
+
+	if (client) {
+		tx_sched_kick();
+	}
+}
+
+void upstream_purge(struct bt_conn *conn, const struct bt_gatt_attr *attr)
+{
+	k_mutex_lock(&clients_lock, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		struct upstream_client *client = &clients[i];
+
+		if (!client->conn || (conn && client->conn != conn)) {
+			continue;
+		}
+
+		for (size_t j = 0; j < ARRAY_SIZE(client->pending); j++) {
+			if (client->pending[j].attr == attr) {
+				client->pending[j].attr = NULL;
+			}
+		}
+	}
+
+	k_mutex_unlock(&clients_lock);
+}
+
+int upstream_filter_get(struct bt_conn *conn, struct upstream_filter *filter)
+{
+	struct upstream_client *client;
+	int err = 0;
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+
+	client = client_get(conn);
+	if (client) {
+		*filter = client->filter;
+	} else {
+		err = -ENOTCONN;
+	}
+
+	k_mutex_unlock(&clients_lock);
+
+	return err;
+}
+
+int upstream_filter_set(struct bt_conn *conn, const struct upstream_filter *filter)
+{
+	struct upstream_client *client;
+	int err = 0;
+
+	if (filter->classes & ~FILTER_ALL_CLASSES) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+
+	client = client_get(conn);
+	if (client) {
+		client->filter = *filter;
+	} else {
+		err = -ENOTCONN;
+	}
+
+	k_mutex_unlock(&clients_lock);
+
+	return err;
+}
+
+int upstream_attach(struct bt_conn *conn)
+{
+	int err = -ENOMEM;
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		struct upstream_client *client = &clients[i];
+		uint8_t gen = client->gen + 1;
+
+		/* A slot still waiting for completions of its last hub is
+		 * not free yet.
+		 */
+		if (client->conn || client->inflight) {
+			continue;
+		}
+
+		memset(client, 0, sizeof(*client));
+		client->gen = gen;
+		client->conn = relay_bt_conn_ref(conn);
+		client->filter.classes = FILTER_ALL_CLASSES;
+		k_work_init_delayable(&client->rate_work, rate_work_handler);
+		printk("Hub %zu connected\n", i);
+		err = 0;
+		break;
+	}
+
+	k_mutex_unlock(&clients_lock);
+
+	return err;
+}
+
+void upstream_detach(struct bt_conn *conn)
+{
+	struct k_work_sync sync;
+	struct upstream_client *client;
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+	client = client_get(conn);
+	k_mutex_unlock(&clients_lock);
+
+	if (!client) {
+		return;
+	}
+
+	/* Detach runs in the BT RX thread, never in the rate work itself. */
+	k_work_cancel_delayable_sync(&client->rate_work, &sync);
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+
+	/* Parked values go; in-flight ones are returned by notify_done()
+	 * as the stack flushes them.
+	 */
+	for (size_t j = 0; j < ARRAY_SIZE(client->pending); j++) {
+		client->pending[j].attr = NULL;
+	}
+	relay_bt_conn_unref(client->conn);
+	client->conn = NULL;
+
+	k_mutex_unlock(&clients_lock);
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct bt_conn_info info;
+
+	if (err || bt_conn_get_info(conn, &info) || info.role != BT_CONN_ROLE_PERIPHERAL) {
+		return;
+	}
+
+	if (upstream_attach(conn)) {
+		printk("No free hub slot\n");
+		bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	upstream_detach(conn);
+}
+
+BT_CONN_CB_DEFINE(upstream_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
@@ -0,0 +1,50 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef UPSTREAM_H_
+#define UPSTREAM_H_
+
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include "tx_sched.h"
+
+/* Per-hub delivery settings, written through the relay hub config
+ * characteristic.
+ */
+struct upstream_filter {
+	uint8_t classes;          /* BIT(enum tx_class) the hub wants */
+	uint16_t min_interval_ms; /* telemetry rate limit, 0 for none */
+};
+
+/* Fan a notification out to every subscribed hub. Hubs that are out of
+ * budget, rate limited or out of TX buffers get the value parked; it is
+ * sent later by upstream_flush(), replaced if a newer one arrives first.
+ */
+void upstream_notify(enum tx_class cls, const struct bt_gatt_attr *attr, uint32_t key,
+		     const void *data, uint16_t len, uint32_t enq_cyc);
+
+/* Send one parked value of class max_cls or higher priority to a hub that
+ * has budget. Returns 1 if a PDU was handed to the host, 0 otherwise.
+ */
+int upstream_flush(enum tx_class max_cls);
+
+/* Park a value for a single hub, e.g. the current value of attr for a hub
+ * that just subscribed, or drop whatever is parked for it on unsubscribe.
+ */
+void upstream_send_to(struct bt_conn *conn, enum tx_class cls, const struct bt_gatt_attr *attr,
+		      uint32_t key, const void *data, uint16_t len);
+/* A NULL conn purges attr for every hub. */
+void upstream_purge(struct bt_conn *conn, const struct bt_gatt_attr *attr);
+
+/* Start or stop serving a hub. Called from the connection callbacks, and
+ * by the benchmark with a mocked connection.
+ */
+int upstream_attach(struct bt_conn *conn);
+void upstream_detach(struct bt_conn *conn);
+
+int upstream_filter_get(struct bt_conn *conn, struct upstream_filter *filter);
+int upstream_filter_set(struct bt_conn *conn, const struct upstream_filter *filter);
+
+#endif /* UPSTREAM_H_ */
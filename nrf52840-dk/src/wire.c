@@ -0,0 +1,358 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/init.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include <string.h>
+
+#include "link.h"
+#include "scatter.h"
+#include "tx_sched.h"
+#include "wire.h"
+#include "wire_frame.h"
+
+/* A batch plus its CRC. */
+#define FRAME_MAX (CONFIG_RELAY_WIRE_BATCH_MAX + 2)
+
+static const struct device *const uart = DEVICE_DT_GET(DT_CHOSEN(relay_wire_uart));
+
+RING_BUF_DECLARE(tx_ring, CONFIG_RELAY_WIRE_TX_BUF);
+RING_BUF_DECLARE(rx_ring, CONFIG_RELAY_WIRE_RX_BUF);
+static struct k_spinlock ring_lock;
+
+static struct k_spinlock batch_lock;
+static uint8_t batch[FRAME_MAX];
+static size_t batch_len;
+static uint8_t tx_enc[WIRE_COBS_MAX(FRAME_MAX)];
+
+/* Only touched from the RX work item. */
+static uint8_t rx_frame[WIRE_COBS_MAX(FRAME_MAX)];
+static size_t rx_len;
+static bool rx_overrun;
+
+static struct wire_stats stats;
+static bool ready;
+
+static void flush_handler(struct k_work *work);
+static void rx_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_handler);
+static K_WORK_DELAYABLE_DEFINE(rx_work, rx_handler);
+
+static void tx_start(void)
+{
+#if defined(CONFIG_UART_INTERRUPT_DRIVEN)
+	uart_irq_tx_enable(uart);
+#else
+	k_work_reschedule(&rx_work, K_NO_WAIT);
+#endif
+}
+
+/* Seal the current batch into a frame in the TX buffer. Called with
+ * batch_lock held; returns true if a frame was queued.
+ */
+static bool batch_flush(void)
+{
+	k_spinlock_key_t key;
+	size_t len = batch_len;
+	bool queued = false;
+
+	if (!len) {
+		return false;
+	}
+
+	len = wire_frame_seal(batch, len, tx_enc);
+	batch_len = 0;
+
+	key = k_spin_lock(&ring_lock);
+	if (ring_buf_space_get(&tx_ring) >= len) {
+		ring_buf_put(&tx_ring, tx_enc, len);
+		queued = true;
+	}
+	k_spin_unlock(&ring_lock, key);
+
+	if (queued) {
+		stats.tx_frames++;
+	} else {
+		stats.tx_drops++;
+	}
+
+	return queued;
+}
+
+static void flush_handler(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&batch_lock);
+	bool queued = batch_flush();
+
+	k_spin_unlock(&batch_lock, key);
+
+	if (queued) {
+		tx_start();
+	}
+}
+
+int wire_send(enum wire_rec type, const void *data, size_t len)
+{
+	k_spinlock_key_t key;
+	bool queued = false;
+	bool first;
+
+	if (2 + len > CONFIG_RELAY_WIRE_BATCH_MAX) {
+		return -EMSGSIZE;
+	}
+
+	if (!ready) {
+		return -ENODEV;
+	}
+
+	key = k_spin_lock(&batch_lock);
+
+	if (batch_len + 2 + len > CONFIG_RELAY_WIRE_BATCH_MAX) {
+		queued = batch_flush();
+	}
+
+	first = (batch_len == 0);
+	batch[batch_len++] = type;
+	batch[batch_len++] = len;
+	memcpy(&batch[batch_len], data, len);
+	batch_len += len;
+	stats.tx_records++;
+
+	k_spin_unlock(&batch_lock, key);
+
+	if (queued) {
+		tx_start();
+	}
+
+	if (first) {
+		k_work_schedule(&flush_work, K_MSEC(CONFIG_RELAY_WIRE_BATCH_MS));
+	}
+
+	return 0;
+}
+
+static void ack(uint8_t tag, uint8_t node, uint8_t status)
+{
+	uint8_t rec[] = { tag, node, status };
+
+	wire_send(WIRE_REC_ACK, rec, sizeof(rec));
+}
+
+static void command_done(int err, void *user_data)
+{
+	uintptr_t ref = (uintptr_t)user_data;
+	uint8_t status = SCATTER_STATUS_OK;
+
+	if (err > 0) {
+		status = err;
+	} else if (err < 0) {
+		status = SCATTER_STATUS_QUEUE_FULL;
+	}
+
+	ack(ref >> 8, ref & 0xff, status);
+}
+
+/* Route a host command the same way as one scatter operation, with one
+ * ack per node written.
+ */
+static void command_rx(const uint8_t *data, uint8_t len)
+{
+	uint8_t tag = data[0];
+	uint8_t node = data[1];
+	uint8_t chr = data[2];
+	bool found = false;
+
+	if (chr >= LINK_CHR_COUNT) {
+		ack(tag, node, SCATTER_STATUS_NO_CHR);
+		return;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		struct relay_link *link = &links[i];
+		uint16_t handle = link_handle(link, chr);
+		uintptr_t ref = (tag << 8) | link->id;
+
+		if (!link->conn || (node != SCATTER_NODE_ALL && node != link->id)) {
+			continue;
+		}
+		found = true;
+
+		if (!handle) {
+			ack(tag, link->id, SCATTER_STATUS_NO_CHR);
+		} else if (tx_sched_write_cb(link->conn, handle, &data[3], len - 3,
+					     command_done, (void *)ref)) {
+			ack(tag, link->id, SCATTER_STATUS_QUEUE_FULL);
+		}
+	}
+
+	if (!found) {
+		ack(tag, node, SCATTER_STATUS_NO_NODE);
+	}
+}
+
+static void frame_rx(uint8_t *frame, size_t len)
+{
+	int end = wire_frame_open(frame, len);
+	size_t pos = 0;
+	const uint8_t *data;
+	uint8_t type;
+	uint8_t rec_len;
+	int err;
+
+	if (end < 0) {
+		stats.rx_errors++;
+		return;
+	}
+	stats.rx_frames++;
+
+	while ((err = wire_rec_next(frame, end, &pos, &type, &data, &rec_len)) > 0) {
+		if (type == WIRE_REC_PING) {
+			wire_send(WIRE_REC_PONG, data, rec_len);
+		} else if (type == WIRE_REC_COMMAND && rec_len >= 3) {
+			command_rx(data, rec_len);
+		}
+	}
+
+	if (err) {
+		stats.rx_errors++;
+	}
+}
+
+static void rx_byte(uint8_t byte)
+{
+	if (byte) {
+		if (rx_len < sizeof(rx_frame)) {
+			rx_frame[rx_len++] = byte;
+		} else {
+			rx_overrun = true;
+		}
+		return;
+	}
+
+	if (rx_overrun) {
+		stats.rx_errors++;
+	} else if (rx_len) {
+		frame_rx(rx_frame, rx_len);
+	}
+
+	rx_len = 0;
+	rx_overrun = false;
+}
+
+#if defined(CONFIG_UART_INTERRUPT_DRIVEN)
+static void rx_handler(struct k_work *work)
+{
+	uint8_t buf[32];
+	uint32_t len;
+
+	for (;;) {
+		k_spinlock_key_t key = k_spin_lock(&ring_lock);
+
+		len = ring_buf_get(&rx_ring, buf, sizeof(buf));
+		k_spin_unlock(&ring_lock, key);
+
+		if (!len) {
+			break;
+		}
+
+		for (uint32_t i = 0; i < len; i++) {
+			rx_byte(buf[i]);
+		}
+	}
+}
+
+static void uart_isr(const struct device *dev, void *user_data)
+{
+	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+		k_spinlock_key_t key;
+		uint8_t *data;
+		uint32_t len;
+		int n;
+
+		if (uart_irq_rx_ready(dev)) {
+			key = k_spin_lock(&ring_lock);
+			len = ring_buf_put_claim(&rx_ring, &data, CONFIG_RELAY_WIRE_RX_BUF);
+			if (len) {
+				n = uart_fifo_read(dev, data, len);
+				ring_buf_put_finish(&rx_ring, MAX(n, 0));
+			} else {
+				uint8_t drop;
+
+				/* RX buffer full; the frame will fail its CRC. */
+				uart_fifo_read(dev, &drop, 1);
+			}
+			k_spin_unlock(&ring_lock, key);
+
+			k_work_reschedule(&rx_work, K_NO_WAIT);
+		}
+
+		if (uart_irq_tx_ready(dev)) {
+			key = k_spin_lock(&ring_lock);
+			len = ring_buf_get_claim(&tx_ring, &data, CONFIG_RELAY_WIRE_TX_BUF);
+			if (len) {
+				n = uart_fifo_fill(dev, data, len);
+				ring_buf_get_finish(&tx_ring, MAX(n, 0));
+			} else {
+				uart_irq_tx_disable(dev);
+			}
+			k_spin_unlock(&ring_lock, key);
+		}
+	}
+}
+#else
+/* Without interrupt support, e.g. on the native_sim pty UART, the RX work
+ * item polls the UART and also drains the TX buffer.
+ */
+static void rx_handler(struct k_work *work)
+{
+	uint8_t buf[32];
+	uint32_t len;
+	k_spinlock_key_t key = k_spin_lock(&ring_lock);
+
+	while ((len = ring_buf_get(&tx_ring, buf, sizeof(buf)))) {
+		k_spin_unlock(&ring_lock, key);
+		for (uint32_t i = 0; i < len; i++) {
+			uart_poll_out(uart, buf[i]);
+		}
+		key = k_spin_lock(&ring_lock);
+	}
+	k_spin_unlock(&ring_lock, key);
+
+	while (!uart_poll_in(uart, buf)) {
+		rx_byte(buf[0]);
+	}
+
+	k_work_schedule(&rx_work, K_MSEC(CONFIG_RELAY_WIRE_POLL_MS));
+}
+#endif
+
+static int wire_init(void)
+{
+	if (!device_is_ready(uart)) {
+		printk("Wire UART not ready\n");
+		return 0;
+	}
+
+#if defined(CONFIG_UART_INTERRUPT_DRIVEN)
+	uart_irq_callback_set(uart, uart_isr);
+	uart_irq_rx_enable(uart);
+#else
+	k_work_schedule(&rx_work, K_MSEC(CONFIG_RELAY_WIRE_POLL_MS));
+#endif
+
+	ready = true;
+
+	return 0;
+}
+
+void wire_stats_get(struct wire_stats *out)
+{
+	*out = stats;
+}
+
+SYS_INIT(wire_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
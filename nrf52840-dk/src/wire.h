@@ -0,0 +1,53 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef WIRE_H_
+#define WIRE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Wired bridge to the hub over UART or USB CDC ACM (CONFIG_RELAY_WIRE).
+ *
+ * Each frame is COBS encoded and ends with a 0x00 delimiter. Decoded, a
+ * frame is a batch of records followed by a CRC-16/CCITT (seed 0xffff,
+ * little endian) over the records:
+ *
+ *   { type u8 | len u8 | data[len] } ... | crc u16
+ */
+enum wire_rec {
+	/* relay -> host: a relay frame, header and value (relay_frame_hdr) */
+	WIRE_REC_SHADOW = 0x01,
+	/* host -> relay: tag u8 | node u8 (0xff = all) | chr u8 | value */
+	WIRE_REC_COMMAND = 0x02,
+	/* relay -> host: tag u8 | node u8 | status u8 (SCATTER_STATUS_*) */
+	WIRE_REC_ACK = 0x03,
+	/* host -> relay, echoed back unchanged as WIRE_REC_PONG */
+	WIRE_REC_PING = 0x04,
+	WIRE_REC_PONG = 0x05,
+};
+
+struct wire_stats {
+	uint32_t tx_frames;
+	uint32_t tx_records;
+	uint32_t tx_drops;   /* frames that did not fit in the TX buffer */
+	uint32_t rx_frames;
+	uint32_t rx_errors;  /* bad COBS, CRC or record framing */
+};
+
+#if defined(CONFIG_RELAY_WIRE)
+/* Add a record to the current batch; the batch goes out when it is full
+ * or CONFIG_RELAY_WIRE_BATCH_MS after its first record.
+ */
+int wire_send(enum wire_rec type, const void *data, size_t len);
+
+void wire_stats_get(struct wire_stats *stats);
+#else
+static inline int wire_send(enum wire_rec type, const void *data, size_t len)
+{
+	return 0;
+}
+#endif
+
+#endif /* WIRE_H_ */
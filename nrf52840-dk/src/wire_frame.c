@@ -0,0 +1,100 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+#include <errno.h>
+
+#include "wire_frame.h"
+
+#define WIRE_CRC_SEED 0xffff
+
+size_t wire_cobs_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	size_t code_pos = 0;
+	size_t out = 1;
+	uint8_t code = 1;
+
+	for (size_t i = 0; i < len; i++) {
+		if (src[i]) {
+			dst[out++] = src[i];
+			code++;
+		}
+
+		if (!src[i] || code == 0xff) {
+			dst[code_pos] = code;
+			code_pos = out++;
+			code = 1;
+		}
+	}
+	dst[code_pos] = code;
+
+	return out;
+}
+
+int wire_cobs_decode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	size_t in = 0;
+	size_t out = 0;
+
+	while (in < len) {
+		uint8_t code = src[in++];
+
+		if (!code || in + code - 1 > len) {
+			return -EINVAL;
+		}
+
+		for (uint8_t i = 1; i < code; i++) {
+			dst[out++] = src[in++];
+		}
+
+		if (code < 0xff && in < len) {
+			dst[out++] = 0;
+		}
+	}
+
+	return out;
+}
+
+size_t wire_frame_seal(uint8_t *batch, size_t len, uint8_t *dst)
+{
+	sys_put_le16(crc16_ccitt(WIRE_CRC_SEED, batch, len), &batch[len]);
+	len = wire_cobs_encode(batch, len + 2, dst);
+	dst[len++] = 0;
+
+	return len;
+}
+
+int wire_frame_open(uint8_t *frame, size_t len)
+{
+	int n = wire_cobs_decode(frame, len, frame);
+
+	if (n < 2 || crc16_ccitt(WIRE_CRC_SEED, frame, n - 2) != sys_get_le16(&frame[n - 2])) {
+		return -EINVAL;
+	}
+
+	return n - 2;
+}
+
+int wire_rec_next(const uint8_t *recs, size_t end, size_t *pos,
+		  uint8_t *type, const uint8_t **data, uint8_t *len)
+{
+	size_t at = *pos;
+
+	if (at >= end) {
+		return 0;
+	}
+
+	if (end - at < 2 || end - at - 2 < recs[at + 1]) {
+		return -EINVAL;
+	}
+
+	*type = recs[at];
+	*len = recs[at + 1];
+	*data = &recs[at + 2];
+	*pos = at + 2 + *len;
+
+	return 1;
+}
@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef WIRE_FRAME_H_
+#define WIRE_FRAME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Framing of the wired bridge (see wire.h), without any I/O so that it
+ * can be tested on the host against raspberry-pi/Wire/wire.py.
+ */
+
+/* Largest encoding of len bytes, with the delimiter. */
+#define WIRE_COBS_MAX(len) ((len) + (len) / 254 + 2)
+
+/* COBS encode len bytes of src into dst; returns the encoded length,
+ * without the delimiter.
+ */
+size_t wire_cobs_encode(const uint8_t *src, size_t len, uint8_t *dst);
+
+/* COBS decode len bytes, delimiter excluded. Decoding never grows the
+ * data, so dst may be src. Returns the decoded length or -EINVAL.
+ */
+int wire_cobs_decode(const uint8_t *src, size_t len, uint8_t *dst);
+
+/* Seal len bytes of records into a frame in dst, delimiter included.
+ * batch must have room for the two CRC bytes after the records, and dst
+ * for WIRE_COBS_MAX(len + 2) bytes. Returns the frame length.
+ */
+size_t wire_frame_seal(uint8_t *batch, size_t len, uint8_t *dst);
+
+/* Decode a frame in place, delimiter excluded, and check its CRC.
+ * Returns the length of the records or -EINVAL.
+ */
+int wire_frame_open(uint8_t *frame, size_t len);
+
+/* Walk the records of an opened frame. On return of 1, *type, *data and
+ * *len describe the record at *pos and *pos is past it; returns 0 at the
+ * end and -EINVAL when a record overruns the frame.
+ */
+int wire_rec_next(const uint8_t *recs, size_t end, size_t *pos,
+		  uint8_t *type, const uint8_t **data, uint8_t *len);
+
+#endif /* WIRE_FRAME_H_ */
@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* The data path benchmark on native_sim. bench.c brings the relay_bt.h
+ * mocks; the parts of the relay outside the data path are stubbed here.
+ * The cycle counts only mean something on hardware, but every run has to
+ * get all its PDUs to the stack.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "bench.h"
+#include "resume.h"
+#include "scan_sched.h"
+
+void resume_save(struct relay_link *link)
+{
+}
+
+void resume_first_rx(struct relay_link *link)
+{
+}
+
+void scan_sched_activity(void)
+{
+}
+
+ZTEST(bench, test_data_path)
+{
+	struct bench_result notify = { .name = "notify" };
+	struct bench_result write = { .name = "write" };
+
+	bench_run(&notify, &write);
+
+	bench_report(&notify);
+	bench_report(&write);
+
+	zassert_equal(notify.timeouts, 0, "%u relayed values lost a PDU", notify.timeouts);
+	zassert_equal(notify.count, CONFIG_RELAY_BENCH_ITERATIONS);
+	zassert_equal(write.timeouts, 0, "%u writes missed a node", write.timeouts);
+	zassert_equal(write.count, CONFIG_RELAY_BENCH_ITERATIONS);
+}
+
+ZTEST_SUITE(bench, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,115 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* The receive sequence window: what each frame is taken for, and what
+ * it does to the gap, duplicate and reorder counters of its link.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <string.h>
+
+#include "link.h"
+#include "relay_bt.h"
+
+static struct relay_link link;
+static struct seq_window window;
+
+struct bt_conn *relay_bt_conn_ref(struct bt_conn *conn)
+{
+	return conn;
+}
+
+void relay_bt_conn_unref(struct bt_conn *conn)
+{
+}
+
+static atomic_val_t stat(enum link_stat stat)
+{
+	return atomic_get(&link_stats[link.id].v[stat]);
+}
+
+static void seq_before(void *fixture)
+{
+	memset(&window, 0, sizeof(window));
+	link_stats_reset();
+}
+
+ZTEST(seq_window, test_in_order)
+{
+	zassert_equal(seq_window_rx(&window, 10, &link), SEQ_IN_ORDER);
+	zassert_equal(seq_window_rx(&window, 11, &link), SEQ_IN_ORDER);
+	zassert_equal(seq_window_rx(&window, 12, &link), SEQ_IN_ORDER);
+
+	zassert_equal(stat(LINK_STAT_GAPS), 0);
+	zassert_equal(stat(LINK_STAT_DUPS), 0);
+	zassert_equal(stat(LINK_STAT_REORDERS), 0);
+}
+
+ZTEST(seq_window, test_gap_filled)
+{
+	seq_window_rx(&window, 10, &link);
+	zassert_equal(seq_window_rx(&window, 13, &link), SEQ_GAP);
+	zassert_equal(stat(LINK_STAT_GAPS), 2);
+
+	zassert_equal(seq_window_rx(&window, 11, &link), SEQ_REORDER);
+	zassert_equal(stat(LINK_STAT_GAPS), 1);
+	zassert_equal(stat(LINK_STAT_REORDERS), 1);
+
+	zassert_equal(seq_window_rx(&window, 11, &link), SEQ_DUP);
+	zassert_equal(stat(LINK_STAT_GAPS), 1);
+	zassert_equal(stat(LINK_STAT_DUPS), 1);
+}
+
+ZTEST(seq_window, test_wrap)
+{
+	seq_window_rx(&window, UINT16_MAX, &link);
+	zassert_equal(seq_window_rx(&window, 0, &link), SEQ_IN_ORDER);
+	zassert_equal(seq_window_rx(&window, UINT16_MAX, &link), SEQ_DUP);
+	zassert_equal(stat(LINK_STAT_GAPS), 0);
+}
+
+ZTEST(seq_window, test_late_after_first)
+{
+	/* Nothing before the first frame was counted as a gap. */
+	seq_window_rx(&window, 10, &link);
+	zassert_equal(seq_window_rx(&window, 9, &link), SEQ_DUP);
+	zassert_equal(seq_window_rx(&window, 10 - 31, &link), SEQ_DUP);
+
+	zassert_equal(stat(LINK_STAT_GAPS), 0);
+	zassert_equal(stat(LINK_STAT_REORDERS), 0);
+	zassert_equal(stat(LINK_STAT_DUPS), 2);
+}
+
+ZTEST(seq_window, test_late_after_restart)
+{
+	seq_window_rx(&window, 100, &link);
+	seq_window_rx(&window, 103, &link);
+	zassert_equal(stat(LINK_STAT_GAPS), 2);
+
+	/* The sender restarted its counter. */
+	zassert_equal(seq_window_rx(&window, 5, &link), SEQ_IN_ORDER);
+	zassert_equal(seq_window_rx(&window, 4, &link), SEQ_DUP);
+	zassert_equal(stat(LINK_STAT_GAPS), 2);
+
+	/* Holes after the restart are counted and filled as usual. */
+	zassert_equal(seq_window_rx(&window, 8, &link), SEQ_GAP);
+	zassert_equal(stat(LINK_STAT_GAPS), 4);
+	zassert_equal(seq_window_rx(&window, 6, &link), SEQ_REORDER);
+	zassert_equal(stat(LINK_STAT_GAPS), 3);
+}
+
+ZTEST(seq_window, test_jump)
+{
+	/* A jump of a whole window or more leaves only counted holes. */
+	seq_window_rx(&window, 10, &link);
+	zassert_equal(seq_window_rx(&window, 50, &link), SEQ_GAP);
+	zassert_equal(stat(LINK_STAT_GAPS), 39);
+
+	zassert_equal(seq_window_rx(&window, 40, &link), SEQ_REORDER);
+	zassert_equal(stat(LINK_STAT_GAPS), 38);
+}
+
+ZTEST_SUITE(seq_window, NULL, NULL, seq_before, NULL, NULL);
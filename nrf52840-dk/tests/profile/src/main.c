@@ -0,0 +1,668 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* The profile against fake nodes and a fake hub: discovery step by step,
+ * values relayed from a node to the hub, hub reads refreshed from a node
+ * and hub writes routed to the nodes. The stack calls in relay_bt.h are
+ * mocked: each is recorded and completed by the test, as the stack would
+ * once the peer answered.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include <string.h>
+
+#include "link.h"
+#include "profile.h"
+#include "relay_bt.h"
+#include "relay_svc.h"
+#include "resume.h"
+#include "scan_sched.h"
+#include "tx_sched.h"
+#include "upstream.h"
+
+#define NODES    2
+#define MOCK_MAX 16
+
+/* Node handles: service, characteristic declaration, value, CCC. */
+#define SVC_HANDLE(chr)   (0x10 + 0x10 * (chr))
+#define CHRC_HANDLE(chr)  (SVC_HANDLE(chr) + 1)
+#define VALUE_HANDLE(chr) (SVC_HANDLE(chr) + 2)
+#define CCC_HANDLE(chr)   (SVC_HANDLE(chr) + 3)
+
+/* Connections are only compared by address on the data path. */
+static uint8_t fake_conns[1 + NODES];
+#define FAKE_HUB     ((struct bt_conn *)&fake_conns[0])
+#define FAKE_NODE(i) ((struct bt_conn *)&fake_conns[1 + (i)])
+
+/* Discovery params are reused from step to step, so keep what each call
+ * asked for.
+ */
+static struct {
+	struct bt_gatt_discover_params *params;
+	uint8_t type;
+	uint16_t start_handle;
+	uint16_t uuid;
+} discovers[MOCK_MAX];
+static size_t discover_count;
+static int discover_ret;
+
+static struct bt_gatt_subscribe_params *subscribes[MOCK_MAX];
+static size_t subscribe_count;
+static int subscribe_ret;
+static size_t resubscribe_count;
+
+static struct {
+	struct bt_conn *conn;
+	struct bt_gatt_read_params *params;
+} reads[MOCK_MAX];
+static size_t read_count;
+static size_t read_done;
+static int read_ret;
+
+static struct {
+	struct bt_conn *conn;
+	struct bt_gatt_write_params *params;
+} writes[MOCK_MAX];
+static size_t write_count;
+static size_t write_done;
+
+static struct {
+	struct bt_conn *conn;
+	const struct bt_gatt_attr *attr;
+	bt_gatt_complete_func_t func;
+	void *user_data;
+	uint8_t data[CONFIG_RELAY_TX_VALUE_MAX];
+	uint16_t len;
+} notifies[MOCK_MAX];
+static size_t notify_count;
+static size_t notify_done;
+
+static struct {
+	enum link_chr chr;
+	uint8_t data[CONFIG_RELAY_TX_VALUE_MAX];
+	uint16_t len;
+} frames[MOCK_MAX];
+static size_t frame_count;
+
+static int refs;
+static int saves;
+static int first_rx;
+
+struct bt_conn *relay_bt_conn_ref(struct bt_conn *conn)
+{
+	refs++;
+	return conn;
+}
+
+void relay_bt_conn_unref(struct bt_conn *conn)
+{
+	refs--;
+}
+
+bool relay_bt_is_subscribed(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			    uint16_t ccc_type)
+{
+	return conn == FAKE_HUB;
+}
+
+int relay_bt_notify(struct bt_conn *conn, struct bt_gatt_notify_params *params)
+{
+	if (notify_count >= ARRAY_SIZE(notifies) || params->len > sizeof(notifies[0].data)) {
+		return -ENOMEM;
+	}
+
+	notifies[notify_count].conn = conn;
+	notifies[notify_count].attr = params->attr;
+	notifies[notify_count].func = params->func;
+	notifies[notify_count].user_data = params->user_data;
+	memcpy(notifies[notify_count].data, params->data, params->len);
+	notifies[notify_count].len = params->len;
+	notify_count++;
+
+	return 0;
+}
+
+int relay_bt_write(struct bt_conn *conn, struct bt_gatt_write_params *params)
+{
+	if (write_count >= ARRAY_SIZE(writes)) {
+		return -ENOMEM;
+	}
+
+	writes[write_count].conn = conn;
+	writes[write_count].params = params;
+	write_count++;
+
+	return 0;
+}
+
+int relay_bt_write_cmd(struct bt_conn *conn, uint16_t handle, const void *data, uint16_t len)
+{
+	return 0;
+}
+
+int relay_bt_discover(struct bt_conn *conn, struct bt_gatt_discover_params *params)
+{
+	if (discover_ret) {
+		return discover_ret;
+	}
+
+	zassert_true(discover_count < ARRAY_SIZE(discovers));
+	discovers[discover_count].params = params;
+	discovers[discover_count].type = params->type;
+	discovers[discover_count].start_handle = params->start_handle;
+	discovers[discover_count].uuid = BT_UUID_16(params->uuid)->val;
+	discover_count++;
+
+	return 0;
+}
+
+int relay_bt_subscribe(struct bt_conn *conn, struct bt_gatt_subscribe_params *params)
+{
+	zassert_true(subscribe_count < ARRAY_SIZE(subscribes));
+	subscribes[subscribe_count++] = params;
+
+	return subscribe_ret;
+}
+
+int relay_bt_resubscribe(struct bt_conn *conn, struct bt_gatt_subscribe_params *params)
+{
+	resubscribe_count++;
+
+	return 0;
+}
+
+int relay_bt_read(struct bt_conn *conn, struct bt_gatt_read_params *params)
+{
+	if (read_ret) {
+		return read_ret;
+	}
+
+	zassert_true(read_count < ARRAY_SIZE(reads));
+	reads[read_count].conn = conn;
+	reads[read_count].params = params;
+	read_count++;
+
+	return 0;
+}
+
+int relay_frame_send(struct relay_link *link, enum link_chr chr,
+		     const void *data, uint16_t len)
+{
+	zassert_true(frame_count < ARRAY_SIZE(frames));
+	frames[frame_count].chr = chr;
+	memcpy(frames[frame_count].data, data, len);
+	frames[frame_count].len = len;
+	frame_count++;
+
+	return 0;
+}
+
+void resume_save(struct relay_link *link)
+{
+	saves++;
+}
+
+void resume_first_rx(struct relay_link *link)
+{
+	first_rx++;
+}
+
+void scan_sched_activity(void)
+{
+}
+
+/* Let the TX scheduler work item run. */
+static void settle(void)
+{
+	k_sleep(K_MSEC(10));
+}
+
+/* Hand the hub's notifications back, as the stack would once sent. */
+static void notify_complete(void)
+{
+	while (notify_done < notify_count) {
+		size_t i = notify_done++;
+
+		notifies[i].func(notifies[i].conn, notifies[i].user_data);
+		settle();
+	}
+}
+
+/* Answer the writes to the nodes, including those the answers let out. */
+static void write_complete(uint8_t err)
+{
+	settle();
+
+	while (write_done < write_count) {
+		size_t i = write_done++;
+
+		writes[i].params->func(writes[i].conn, err, writes[i].params);
+		settle();
+	}
+}
+
+/* Answer the node reads with data, or fail them when there is none. */
+static void read_complete(const void *data, uint16_t len)
+{
+	while (read_done < read_count) {
+		size_t i = read_done++;
+		struct bt_gatt_read_params *params = reads[i].params;
+
+		zassert_equal(params->func(reads[i].conn, data ? 0 : BT_ATT_ERR_UNLIKELY,
+					   params, data, len), BT_GATT_ITER_STOP);
+	}
+}
+
+/* The characteristic value attribute a hub reads and writes. */
+static const struct bt_gatt_attr *value_attr(enum link_chr chr)
+{
+	return &profile_chrs[chr].svc->attrs[2];
+}
+
+/* Give node i the handles of every characteristic, as resuming would. */
+static void node_handles(int i)
+{
+	uint16_t value[LINK_CHR_COUNT];
+	uint16_t ccc[LINK_CHR_COUNT];
+
+	for (int chr = 0; chr < LINK_CHR_COUNT; chr++) {
+		value[chr] = VALUE_HANDLE(chr);
+		ccc[chr] = CCC_HANDLE(chr);
+	}
+
+	zassert_ok(profile_resume(&links[i], value, ccc, 0));
+}
+
+static void profile_before(void *fixture)
+{
+	discover_count = 0;
+	discover_ret = 0;
+	subscribe_count = 0;
+	subscribe_ret = 0;
+	resubscribe_count = 0;
+	read_count = 0;
+	read_done = 0;
+	read_ret = 0;
+	write_count = 0;
+	write_done = 0;
+	notify_count = 0;
+	notify_done = 0;
+	frame_count = 0;
+	saves = 0;
+	first_rx = 0;
+
+	for (int i = 0; i < NODES; i++) {
+		zassert_not_null(link_alloc(FAKE_NODE(i)));
+	}
+
+	zassert_ok(upstream_attach(FAKE_HUB));
+}
+
+static void profile_after(void *fixture)
+{
+	read_complete(NULL, 0);
+	write_complete(0);
+	notify_complete();
+
+	upstream_detach(FAKE_HUB);
+
+	for (int i = 0; i < NODES; i++) {
+		link_free(&links[i]);
+	}
+
+	settle();
+	zassert_equal(refs, 0, "%d connection references left", refs);
+}
+
+/* Discovery: service, then characteristic, then CCC, then subscribe. */
+
+ZTEST(profile_discovery, test_steps)
+{
+	struct relay_link *link = &links[0];
+	struct bt_gatt_discover_params *params;
+	struct bt_gatt_chrc chrc = { .value_handle = VALUE_HANDLE(LINK_CHR_TEMP) };
+	struct bt_gatt_attr svc_attr = { .handle = SVC_HANDLE(LINK_CHR_TEMP) };
+	struct bt_gatt_attr chrc_attr = BT_GATT_ATTRIBUTE(BT_UUID_GATT_CHRC, BT_GATT_PERM_READ,
+							  bt_gatt_attr_read_chrc, NULL, &chrc);
+	struct bt_gatt_attr ccc_attr = { .handle = CCC_HANDLE(LINK_CHR_TEMP) };
+	struct bt_gatt_subscribe_params *sub = &link->subscribe_params[LINK_CHR_TEMP];
+
+	chrc_attr.handle = CHRC_HANDLE(LINK_CHR_TEMP);
+
+	/* Every characteristic looks for its service at once. */
+	profile_discover(link);
+	zassert_equal(discover_count, LINK_CHR_COUNT);
+	for (int chr = 0; chr < LINK_CHR_COUNT; chr++) {
+		zassert_equal(discovers[chr].params, &link->discover_params[chr]);
+		zassert_equal(discovers[chr].type, BT_GATT_DISCOVER_PRIMARY);
+		zassert_equal(discovers[chr].uuid, profile_chrs[chr].svc_uuid);
+	}
+
+	params = &link->discover_params[LINK_CHR_TEMP];
+	zassert_equal(params->func(FAKE_NODE(0), &svc_attr, params), BT_GATT_ITER_STOP);
+	zassert_equal(discover_count, LINK_CHR_COUNT + 1);
+	zassert_equal(discovers[LINK_CHR_COUNT].type, BT_GATT_DISCOVER_CHARACTERISTIC);
+	zassert_equal(discovers[LINK_CHR_COUNT].start_handle, CHRC_HANDLE(LINK_CHR_TEMP));
+	zassert_equal(discovers[LINK_CHR_COUNT].uuid, BT_UUID_TEMPERATURE_VAL);
+
+	zassert_equal(params->func(FAKE_NODE(0), &chrc_attr, params), BT_GATT_ITER_STOP);
+	zassert_equal(discover_count, LINK_CHR_COUNT + 2);
+	zassert_equal(discovers[LINK_CHR_COUNT + 1].type, BT_GATT_DISCOVER_DESCRIPTOR);
+	zassert_equal(discovers[LINK_CHR_COUNT + 1].start_handle, CCC_HANDLE(LINK_CHR_TEMP));
+	zassert_equal(discovers[LINK_CHR_COUNT + 1].uuid, BT_UUID_GATT_CCC_VAL);
+	zassert_equal(link_handle(link, LINK_CHR_TEMP), VALUE_HANDLE(LINK_CHR_TEMP));
+
+	/* The LED service is not on this node: settled, but nothing saved
+	 * until the temperature is subscribed too.
+	 */
+	params = &link->discover_params[LINK_CHR_LED];
+	zassert_equal(params->func(FAKE_NODE(0), NULL, params), BT_GATT_ITER_STOP);
+	zassert_false(link_settled(link));
+	zassert_equal(saves, 0);
+
+	params = &link->discover_params[LINK_CHR_TEMP];
+	zassert_equal(params->func(FAKE_NODE(0), &ccc_attr, params), BT_GATT_ITER_STOP);
+	zassert_equal(discover_count, LINK_CHR_COUNT + 2, "discovered past the CCC");
+	zassert_equal(subscribe_count, 1);
+	zassert_equal(subscribes[0], sub);
+	zassert_equal(sub->value_handle, VALUE_HANDLE(LINK_CHR_TEMP));
+	zassert_equal(sub->ccc_handle, CCC_HANDLE(LINK_CHR_TEMP));
+	zassert_equal(sub->value, BT_GATT_CCC_NOTIFY);
+	zassert_not_null(sub->notify);
+
+	zassert_true(link_settled(link));
+	zassert_equal(saves, 1);
+}
+
+ZTEST(profile_discovery, test_subscribe_failed)
+{
+	struct relay_link *link = &links[0];
+	struct bt_gatt_discover_params *params = &link->discover_params[LINK_CHR_LED];
+	struct bt_gatt_attr ccc_attr = { .handle = CCC_HANDLE(LINK_CHR_LED) };
+
+	profile_discover(link);
+
+	/* Straight to the last step; the others are covered above. */
+	params->type = BT_GATT_DISCOVER_DESCRIPTOR;
+	subscribe_ret = -ENOMEM;
+	params->func(FAKE_NODE(0), &ccc_attr, params);
+
+	zassert_equal(subscribe_count, 1);
+	zassert_equal(link->subscribed, 0);
+	zassert_false(link->settled & BIT(LINK_CHR_LED));
+	zassert_equal(saves, 0);
+}
+
+ZTEST(profile_discovery, test_discover_busy)
+{
+	discover_ret = -ENOMEM;
+
+	profile_discover(&links[0]);
+
+	zassert_equal(discover_count, 0);
+	zassert_false(link_settled(&links[0]));
+}
+
+ZTEST(profile_discovery, test_resume_needs_all_handles)
+{
+	uint16_t value[LINK_CHR_COUNT] = { [LINK_CHR_TEMP] = VALUE_HANDLE(LINK_CHR_TEMP) };
+	uint16_t ccc[LINK_CHR_COUNT] = { [LINK_CHR_TEMP] = CCC_HANDLE(LINK_CHR_TEMP) };
+
+	/* LED neither cached nor known to be absent: discover instead. */
+	zassert_equal(profile_resume(&links[0], value, ccc, 0), -ENOENT);
+	zassert_equal(resubscribe_count, 0);
+	zassert_false(link_settled(&links[0]));
+
+	zassert_ok(profile_resume(&links[0], value, ccc, BIT(LINK_CHR_LED)));
+	zassert_equal(resubscribe_count, 1);
+	zassert_true(link_settled(&links[0]));
+	zassert_equal(link_handle(&links[0], LINK_CHR_LED), 0);
+}
+
+ZTEST_SUITE(profile_discovery, NULL, NULL, profile_before, profile_after, NULL);
+
+/* Notify relay: a node's value goes to the hub as a frame and mirrored. */
+
+static void notify_from(int i, enum link_chr chr, const void *data, uint16_t len)
+{
+	struct bt_gatt_subscribe_params *sub = &links[i].subscribe_params[chr];
+
+	zassert_equal(sub->notify(FAKE_NODE(i), sub, data, len), BT_GATT_ITER_CONTINUE);
+	settle();
+}
+
+static void expect_relayed(enum link_chr chr, const uint8_t *expect, uint16_t len)
+{
+	zassert_equal(frame_count, 1);
+	zassert_equal(frames[0].chr, chr);
+	zassert_equal(frames[0].len, len);
+	zassert_mem_equal(frames[0].data, expect, len);
+
+	zassert_equal(notify_count, 1);
+	zassert_equal(notifies[0].conn, FAKE_HUB);
+	zassert_equal(notifies[0].attr, profile_attr(chr));
+	zassert_equal(notifies[0].len, len);
+	zassert_mem_equal(notifies[0].data, expect, len);
+	zassert_mem_equal(profile_chrs[chr].value, expect, len);
+}
+
+static void profile_notify_before(void *fixture)
+{
+	profile_before(fixture);
+	node_handles(0);
+}
+
+ZTEST(profile_notify, test_temperature)
+{
+	uint8_t temp[2];
+
+	sys_put_le16(2150, temp);
+	notify_from(0, LINK_CHR_TEMP, temp, sizeof(temp));
+
+	expect_relayed(LINK_CHR_TEMP, temp, sizeof(temp));
+	zassert_equal(first_rx, 1);
+}
+
+ZTEST(profile_notify, test_legacy_widened)
+{
+	const int8_t legacy = 21;
+	uint8_t expect[2];
+
+	sys_put_le16(2100, expect);
+	notify_from(0, LINK_CHR_TEMP, &legacy, sizeof(legacy));
+
+	expect_relayed(LINK_CHR_TEMP, expect, sizeof(expect));
+}
+
+ZTEST(profile_notify, test_legacy_negative)
+{
+	const int8_t legacy = -5;
+	uint8_t expect[2];
+
+	sys_put_le16((uint16_t)-500, expect);
+	notify_from(0, LINK_CHR_TEMP, &legacy, sizeof(legacy));
+
+	expect_relayed(LINK_CHR_TEMP, expect, sizeof(expect));
+}
+
+ZTEST(profile_notify, test_led_not_widened)
+{
+	const uint8_t led = 0x01;
+
+	/* Only the temperature has a legacy format. */
+	notify_from(0, LINK_CHR_LED, &led, sizeof(led));
+
+	expect_relayed(LINK_CHR_LED, &led, sizeof(led));
+}
+
+ZTEST(profile_notify, test_unsubscribed)
+{
+	struct bt_gatt_subscribe_params *sub = &links[0].subscribe_params[LINK_CHR_TEMP];
+
+	zassert_equal(sub->notify(FAKE_NODE(0), sub, NULL, 0), BT_GATT_ITER_STOP);
+	settle();
+
+	zassert_equal(link_handle(&links[0], LINK_CHR_TEMP), 0);
+	zassert_equal(frame_count, 0);
+	zassert_equal(notify_count, 0);
+}
+
+ZTEST_SUITE(profile_notify, NULL, NULL, profile_notify_before, profile_after, NULL);
+
+/* Read refresh: a hub read returns the last value and asks a node for the
+ * next one.
+ */
+
+static ssize_t hub_read(enum link_chr chr, uint8_t *buf, uint16_t len)
+{
+	const struct bt_gatt_attr *attr = value_attr(chr);
+
+	return attr->read(FAKE_HUB, attr, buf, len, 0);
+}
+
+ZTEST(profile_read, test_refresh)
+{
+	const int8_t legacy = 19;
+	uint8_t buf[4];
+	uint8_t expect[2];
+
+	node_handles(1);
+
+	zassert_equal(hub_read(LINK_CHR_TEMP, buf, sizeof(buf)), profile_chrs[LINK_CHR_TEMP].size);
+	zassert_equal(read_count, 1);
+	zassert_equal(reads[0].conn, FAKE_NODE(1));
+	zassert_equal(reads[0].params->handle_count, 1);
+	zassert_equal(reads[0].params->single.handle, VALUE_HANDLE(LINK_CHR_TEMP));
+
+	/* One read at a time per characteristic. */
+	hub_read(LINK_CHR_TEMP, buf, sizeof(buf));
+	zassert_equal(read_count, 1);
+
+	/* The reply is widened like a notification and served next time. */
+	read_complete(&legacy, sizeof(legacy));
+	sys_put_le16(1900, expect);
+	zassert_equal(hub_read(LINK_CHR_TEMP, buf, sizeof(buf)), sizeof(expect));
+	zassert_mem_equal(buf, expect, sizeof(expect));
+	zassert_equal(read_count, 2);
+}
+
+ZTEST(profile_read, test_first_node)
+{
+	uint8_t buf[4];
+
+	node_handles(0);
+	node_handles(1);
+
+	hub_read(LINK_CHR_LED, buf, sizeof(buf));
+	zassert_equal(read_count, 1);
+	zassert_equal(reads[0].conn, FAKE_NODE(0));
+	zassert_equal(reads[0].params->single.handle, VALUE_HANDLE(LINK_CHR_LED));
+}
+
+ZTEST(profile_read, test_no_node)
+{
+	uint8_t buf[4];
+
+	/* Nobody has the characteristic: the last value, no read. */
+	zassert_equal(hub_read(LINK_CHR_TEMP, buf, sizeof(buf)), profile_chrs[LINK_CHR_TEMP].size);
+	zassert_equal(read_count, 0);
+}
+
+ZTEST(profile_read, test_read_failed)
+{
+	uint8_t buf[4];
+
+	node_handles(0);
+
+	/* A read the stack refused is not waited for. */
+	read_ret = -ENOMEM;
+	hub_read(LINK_CHR_TEMP, buf, sizeof(buf));
+	zassert_equal(read_count, 0);
+
+	read_ret = 0;
+	hub_read(LINK_CHR_TEMP, buf, sizeof(buf));
+	zassert_equal(read_count, 1);
+}
+
+ZTEST_SUITE(profile_read, NULL, NULL, profile_before, profile_after, NULL);
+
+/* Write routing: one write per node, errors merged into one result. */
+
+static void profile_write_before(void *fixture)
+{
+	profile_before(fixture);
+
+	for (int i = 0; i < NODES; i++) {
+		node_handles(i);
+	}
+}
+
+ZTEST(profile_write, test_all_nodes)
+{
+	const uint8_t led = 0x01;
+
+	zassert_equal(profile_route_write(LINK_CHR_LED, &led, sizeof(led)), NODES);
+	settle();
+
+	zassert_equal(write_count, NODES);
+	for (int i = 0; i < NODES; i++) {
+		zassert_equal(writes[i].conn, FAKE_NODE(i));
+		zassert_equal(writes[i].params->handle, VALUE_HANDLE(LINK_CHR_LED));
+		zassert_equal(writes[i].params->length, sizeof(led));
+		zassert_equal(((const uint8_t *)writes[i].params->data)[0], led);
+	}
+}
+
+ZTEST(profile_write, test_no_node)
+{
+	const uint8_t led = 0x01;
+
+	links[0].subscribe_params[LINK_CHR_LED].value_handle = 0;
+	links[1].subscribe_params[LINK_CHR_LED].value_handle = 0;
+
+	zassert_equal(profile_route_write(LINK_CHR_LED, &led, sizeof(led)), -ENOTCONN);
+}
+
+ZTEST(profile_write, test_all_failed)
+{
+	uint8_t big[CONFIG_RELAY_TX_VALUE_MAX + 1] = { 0 };
+	const struct bt_gatt_attr *attr = value_attr(LINK_CHR_LED);
+
+	/* The first error is what comes back... */
+	zassert_equal(profile_route_write(LINK_CHR_LED, big, sizeof(big)), -EMSGSIZE);
+
+	/* ...and the hub gets an ATT error. */
+	zassert_equal(attr->write(FAKE_HUB, attr, big, sizeof(big), 0, 0),
+		      BT_GATT_ERR(BT_ATT_ERR_UNLIKELY));
+	settle();
+	zassert_equal(write_count, 0);
+}
+
+ZTEST(profile_write, test_some_failed)
+{
+	const uint8_t led = 0x01;
+	int queued = 0;
+
+	/* Fill the TX queue but for one item; each node takes one write at
+	 * a time and nothing answers, so the rest stay queued.
+	 */
+	while (queued + NODES <= CONFIG_RELAY_TX_QUEUE_SIZE - 1) {
+		zassert_equal(profile_route_write(LINK_CHR_LED, &led, sizeof(led)), NODES);
+		queued += NODES;
+	}
+	while (queued < CONFIG_RELAY_TX_QUEUE_SIZE - 1) {
+		zassert_ok(tx_sched_write(FAKE_NODE(0), VALUE_HANDLE(LINK_CHR_LED),
+					  &led, sizeof(led)));
+		queued++;
+	}
+
+	/* One node still got the write: a success. */
+	zassert_equal(profile_route_write(LINK_CHR_LED, &led, sizeof(led)), 1);
+	zassert_equal(profile_route_write(LINK_CHR_LED, &led, sizeof(led)), -ENOMEM);
+}
+
+ZTEST_SUITE(profile_write, NULL, NULL, profile_write_before, profile_after, NULL);
@@ -0,0 +1,260 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Scatter writes from a hub, through the TX scheduler to the nodes and
+ * back to the hub as one completion, with the stack calls in relay_bt.h
+ * mocked: writes and notifications are recorded and completed by the
+ * test, as the stack would once the peers answered.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <string.h>
+
+#include "link.h"
+#include "relay_bt.h"
+#include "scan_sched.h"
+#include "scatter.h"
+#include "upstream.h"
+
+#define NODES     2
+#define LED_VALUE 0x0010
+#define MOCK_MAX  8
+
+/* Connections are only compared by address on the data path. */
+static uint8_t fake_conns[1 + NODES];
+#define FAKE_HUB     ((struct bt_conn *)&fake_conns[0])
+#define FAKE_NODE(i) ((struct bt_conn *)&fake_conns[1 + (i)])
+
+static struct bt_gatt_attr scatter_attr;
+
+static struct {
+	struct bt_conn *conn;
+	struct bt_gatt_write_params *params;
+} writes[MOCK_MAX];
+static size_t write_count;
+
+static struct {
+	struct bt_conn *conn;
+	bt_gatt_complete_func_t func;
+	void *user_data;
+	uint8_t data[2 + CONFIG_RELAY_SCATTER_MAX_OPS];
+	uint16_t len;
+} notifies[MOCK_MAX];
+static size_t notify_count;
+
+static int refs;
+static bool hub_subscribed;
+
+struct bt_conn *relay_bt_conn_ref(struct bt_conn *conn)
+{
+	refs++;
+	return conn;
+}
+
+void relay_bt_conn_unref(struct bt_conn *conn)
+{
+	refs--;
+}
+
+bool relay_bt_is_subscribed(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			    uint16_t ccc_type)
+{
+	return conn == FAKE_HUB && hub_subscribed;
+}
+
+int relay_bt_notify(struct bt_conn *conn, struct bt_gatt_notify_params *params)
+{
+	if (notify_count >= ARRAY_SIZE(notifies) || params->len > sizeof(notifies[0].data)) {
+		return -ENOMEM;
+	}
+
+	notifies[notify_count].conn = conn;
+	notifies[notify_count].func = params->func;
+	notifies[notify_count].user_data = params->user_data;
+	memcpy(notifies[notify_count].data, params->data, params->len);
+	notifies[notify_count].len = params->len;
+	notify_count++;
+
+	return 0;
+}
+
+int relay_bt_write(struct bt_conn *conn, struct bt_gatt_write_params *params)
+{
+	if (write_count >= ARRAY_SIZE(writes)) {
+		return -ENOMEM;
+	}
+
+	writes[write_count].conn = conn;
+	writes[write_count].params = params;
+	write_count++;
+
+	return 0;
+}
+
+int relay_bt_write_cmd(struct bt_conn *conn, uint16_t handle, const void *data, uint16_t len)
+{
+	return 0;
+}
+
+void scan_sched_activity(void)
+{
+}
+
+/* Let the TX scheduler work item run. */
+static void settle(void)
+{
+	k_sleep(K_MSEC(10));
+}
+
+/* Answer the write to node i with an ATT error, or 0 for success. */
+static void write_respond(size_t i, uint8_t err)
+{
+	struct bt_gatt_write_params *params = writes[i].params;
+
+	params->func(writes[i].conn, err, params);
+	settle();
+}
+
+/* The hub got exactly one completion: id, count, statuses. */
+static void expect_completion(const uint8_t *expect, size_t len)
+{
+	zassert_equal(notify_count, 1, "%zu completions", notify_count);
+	zassert_equal(notifies[0].conn, FAKE_HUB);
+	zassert_equal(notifies[0].len, len);
+	zassert_mem_equal(notifies[0].data, expect, len);
+
+	notifies[0].func(notifies[0].conn, notifies[0].user_data);
+}
+
+static void scatter_before(void *fixture)
+{
+	write_count = 0;
+	notify_count = 0;
+	hub_subscribed = true;
+
+	for (int i = 0; i < NODES; i++) {
+		struct relay_link *link = link_alloc(FAKE_NODE(i));
+
+		link->subscribe_params[LINK_CHR_LED].value_handle = LED_VALUE;
+	}
+
+	zassert_ok(upstream_attach(FAKE_HUB));
+}
+
+static void scatter_after(void *fixture)
+{
+	upstream_detach(FAKE_HUB);
+
+	for (int i = 0; i < NODES; i++) {
+		link_free(&links[i]);
+	}
+
+	settle();
+	zassert_equal(refs, 0, "%d connection references left", refs);
+}
+
+ZTEST(scatter, test_all_nodes)
+{
+	const uint8_t op[] = { 5, SCATTER_NODE_ALL, LINK_CHR_LED, 1, 0x01 };
+	const uint8_t expect[] = { 5, 1, SCATTER_STATUS_OK };
+
+	zassert_ok(scatter_submit(FAKE_HUB, &scatter_attr, op, sizeof(op)));
+	settle();
+
+	/* Both nodes are written at once, before either answers. */
+	zassert_equal(write_count, NODES);
+	zassert_equal(writes[0].params->handle, LED_VALUE);
+	zassert_equal(writes[0].params->length, 1);
+	zassert_equal(((const uint8_t *)writes[0].params->data)[0], 0x01);
+	zassert_not_equal(writes[0].conn, writes[1].conn);
+
+	write_respond(0, 0);
+	zassert_equal(notify_count, 0, "completed before the last node answered");
+
+	write_respond(1, 0);
+	expect_completion(expect, sizeof(expect));
+}
+
+ZTEST(scatter, test_node_error)
+{
+	const uint8_t op[] = { 6, SCATTER_NODE_ALL, LINK_CHR_LED, 1, 0x00 };
+	const uint8_t expect[] = { 6, 1, BT_ATT_ERR_WRITE_NOT_PERMITTED };
+
+	zassert_ok(scatter_submit(FAKE_HUB, &scatter_attr, op, sizeof(op)));
+	settle();
+	zassert_equal(write_count, NODES);
+
+	/* A later success does not hide the error. */
+	write_respond(0, BT_ATT_ERR_WRITE_NOT_PERMITTED);
+	write_respond(1, 0);
+	expect_completion(expect, sizeof(expect));
+}
+
+ZTEST(scatter, test_per_op_status)
+{
+	const uint8_t ops[] = {
+		7,
+		0, LINK_CHR_LED, 1, 0x01,
+		9, LINK_CHR_LED, 1, 0x01,
+		1, LINK_CHR_COUNT, 1, 0x01,
+	};
+	const uint8_t expect[] = {
+		7, 3, SCATTER_STATUS_OK, SCATTER_STATUS_NO_NODE, SCATTER_STATUS_NO_CHR,
+	};
+
+	zassert_ok(scatter_submit(FAKE_HUB, &scatter_attr, ops, sizeof(ops)));
+	settle();
+
+	zassert_equal(write_count, 1);
+	zassert_equal(writes[0].conn, FAKE_NODE(0));
+
+	write_respond(0, 0);
+	expect_completion(expect, sizeof(expect));
+}
+
+ZTEST(scatter, test_nothing_queued)
+{
+	const uint8_t op[] = { 8, 9, LINK_CHR_LED, 1, 0x01 };
+	const uint8_t expect[] = { 8, 1, SCATTER_STATUS_NO_NODE };
+
+	/* No write to wait for: the completion goes out right away. */
+	zassert_ok(scatter_submit(FAKE_HUB, &scatter_attr, op, sizeof(op)));
+	settle();
+
+	zassert_equal(write_count, 0);
+	expect_completion(expect, sizeof(expect));
+}
+
+ZTEST(scatter, test_not_subscribed)
+{
+	const uint8_t op[] = { 9, 0, LINK_CHR_LED, 1, 0x01 };
+
+	hub_subscribed = false;
+
+	zassert_ok(scatter_submit(FAKE_HUB, &scatter_attr, op, sizeof(op)));
+	settle();
+	write_respond(0, 0);
+
+	/* No completion, and the batch still lets go of the hub. */
+	zassert_equal(notify_count, 0);
+}
+
+ZTEST(scatter, test_malformed)
+{
+	const uint8_t short_value[] = { 10, 0, LINK_CHR_LED, 2, 0x01 };
+	const uint8_t no_ops[] = { 11 };
+
+	zassert_equal(scatter_submit(FAKE_HUB, &scatter_attr, short_value,
+				     sizeof(short_value)), -EINVAL);
+	zassert_equal(scatter_submit(FAKE_HUB, &scatter_attr, no_ops, sizeof(no_ops)),
+		      -EINVAL);
+	settle();
+
+	zassert_equal(write_count, 0);
+	zassert_equal(notify_count, 0);
+}
+
+ZTEST_SUITE(scatter, NULL, NULL, scatter_before, scatter_after, NULL);
@@ -0,0 +1,167 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/ztest.h>
+
+#include <string.h>
+
+#include "wire.h"
+#include "wire_frame.h"
+
+/* Frames from raspberry-pi/Wire/wire.py encode_frame(), so that both ends
+ * of the bridge agree byte for byte.
+ */
+static const uint8_t ping_recs[] = {
+	0x04, 0x04, 0x01, 0x02, 0x03, 0x04,
+};
+
+static const uint8_t ping_frame[] = {
+	0x09, 0x04, 0x04, 0x01, 0x02, 0x03, 0x04, 0x83, 0xf0, 0x00,
+};
+
+/* A shadow record with zeros in its header and value. */
+static const uint8_t shadow_recs[] = {
+	0x01, 0x08, 0x00, 0x00, 0x34, 0x12, 0x00, 0x00, 0x10, 0x09,
+};
+
+static const uint8_t shadow_frame[] = {
+	0x03, 0x01, 0x08, 0x01, 0x03, 0x34, 0x12, 0x01, 0x05, 0x10, 0x09, 0x8e,
+	0xb2, 0x00,
+};
+
+/* Shadow, command(7, NODE_ALL, CHR_LED, b'\x01') and ack. */
+static const uint8_t batch_recs[] = {
+	0x01, 0x08, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0xc4, 0x09, 0x02, 0x04,
+	0x07, 0xff, 0x01, 0x01, 0x03, 0x03, 0x07, 0x01, 0x00,
+};
+
+static const uint8_t batch_frame[] = {
+	0x04, 0x01, 0x08, 0x01, 0x02, 0x02, 0x02, 0x01, 0x0d, 0xc4, 0x09, 0x02,
+	0x04, 0x07, 0xff, 0x01, 0x01, 0x03, 0x03, 0x07, 0x01, 0x03, 0x82, 0x97,
+	0x00,
+};
+
+/* PING with 1..250: 254 non-zero bytes fill a whole 0xff COBS block. */
+#define LONG_VALUE_LEN 250
+
+static const uint8_t long_frame_tail[] = {
+	0xfa, 0x11, 0xd4, 0x01, 0x00,
+};
+
+static uint8_t batch[300];
+static uint8_t frame[WIRE_COBS_MAX(sizeof(batch))];
+
+static size_t seal(const uint8_t *recs, size_t len)
+{
+	memcpy(batch, recs, len);
+
+	return wire_frame_seal(batch, len, frame);
+}
+
+static void check_seal(const uint8_t *recs, size_t len, const uint8_t *expect,
+		       size_t expect_len)
+{
+	size_t n = seal(recs, len);
+
+	zassert_equal(n, expect_len, "frame length %zu", n);
+	zassert_mem_equal(frame, expect, expect_len);
+}
+
+/* Open a frame from wire.py, delimiter dropped, and compare its records. */
+static void check_open(const uint8_t *expect_frame, size_t frame_len,
+		       const uint8_t *recs, size_t len)
+{
+	int n;
+
+	memcpy(frame, expect_frame, frame_len);
+	n = wire_frame_open(frame, frame_len - 1);
+
+	zassert_equal(n, len, "records length %d", n);
+	zassert_mem_equal(frame, recs, len);
+}
+
+ZTEST(wire_frame, test_seal_matches_host)
+{
+	check_seal(ping_recs, sizeof(ping_recs), ping_frame, sizeof(ping_frame));
+	check_seal(shadow_recs, sizeof(shadow_recs), shadow_frame, sizeof(shadow_frame));
+	check_seal(batch_recs, sizeof(batch_recs), batch_frame, sizeof(batch_frame));
+}
+
+ZTEST(wire_frame, test_open_host_frames)
+{
+	check_open(ping_frame, sizeof(ping_frame), ping_recs, sizeof(ping_recs));
+	check_open(shadow_frame, sizeof(shadow_frame), shadow_recs, sizeof(shadow_recs));
+	check_open(batch_frame, sizeof(batch_frame), batch_recs, sizeof(batch_recs));
+}
+
+ZTEST(wire_frame, test_long_block)
+{
+	uint8_t recs[2 + LONG_VALUE_LEN];
+	size_t n;
+
+	recs[0] = WIRE_REC_PING;
+	recs[1] = LONG_VALUE_LEN;
+	for (size_t i = 0; i < LONG_VALUE_LEN; i++) {
+		recs[2 + i] = i + 1;
+	}
+
+	n = seal(recs, sizeof(recs));
+	zassert_equal(n, 257, "frame length %zu", n);
+	zassert_equal(frame[0], 0xff);
+	zassert_mem_equal(&frame[n - sizeof(long_frame_tail)], long_frame_tail,
+			  sizeof(long_frame_tail));
+	zassert_equal(memchr(frame, 0, n - 1), NULL, "delimiter inside the frame");
+
+	zassert_equal(wire_frame_open(frame, n - 1), sizeof(recs));
+	zassert_mem_equal(frame, recs, sizeof(recs));
+}
+
+ZTEST(wire_frame, test_records)
+{
+	const uint8_t *data;
+	size_t pos = 0;
+	uint8_t type;
+	uint8_t len;
+
+	zassert_equal(wire_rec_next(batch_recs, sizeof(batch_recs), &pos, &type, &data, &len), 1);
+	zassert_equal(type, WIRE_REC_SHADOW);
+	zassert_equal(len, 8);
+
+	zassert_equal(wire_rec_next(batch_recs, sizeof(batch_recs), &pos, &type, &data, &len), 1);
+	zassert_equal(type, WIRE_REC_COMMAND);
+	zassert_equal(len, 4);
+	zassert_equal(data[0], 7);
+	zassert_equal(data[1], 0xff);
+
+	zassert_equal(wire_rec_next(batch_recs, sizeof(batch_recs), &pos, &type, &data, &len), 1);
+	zassert_equal(type, WIRE_REC_ACK);
+	zassert_equal(len, 3);
+
+	zassert_equal(wire_rec_next(batch_recs, sizeof(batch_recs), &pos, &type, &data, &len), 0);
+
+	/* The last record claims one byte more than the frame holds. */
+	pos = 0;
+	zassert_equal(wire_rec_next(ping_recs, sizeof(ping_recs) - 1, &pos, &type, &data, &len),
+		      -EINVAL);
+}
+
+ZTEST(wire_frame, test_bad_frames)
+{
+	/* Flipped value bit: the CRC no longer matches. */
+	memcpy(frame, ping_frame, sizeof(ping_frame));
+	frame[3] ^= 0x01;
+	zassert_equal(wire_frame_open(frame, sizeof(ping_frame) - 1), -EINVAL);
+
+	/* COBS block running past the end. */
+	memcpy(frame, ping_frame, sizeof(ping_frame));
+	frame[0] = 0x20;
+	zassert_equal(wire_frame_open(frame, sizeof(ping_frame) - 1), -EINVAL);
+
+	/* Too short to hold a CRC. */
+	frame[0] = 0x02;
+	frame[1] = 0x55;
+	zassert_equal(wire_frame_open(frame, 2), -EINVAL);
+}
+
+ZTEST_SUITE(wire_frame, NULL, NULL, NULL, NULL, NULL);
@@ -2,6 +2,7 @@ import bluezutils
 import pydbus
 import dbus
 import binascii
+import struct
 
 device_address = []
 TEMPERATURE_UUID = '0x2a6e'
@@ -33,8 +34,15 @@ def generic_error_cb(error):
     print('D-Bus call failed: ' + str(error))
     # mainloop.quit()
 
+def parse_temperature(value):
+    """sint16 LE in 0.01 degree units, or a legacy single byte of whole degrees"""
+    value = bytes(value)
+    if len(value) == 1:
+        return float(struct.unpack('<b', value)[0])
+    return struct.unpack('<h', value[:2])[0] / 100
+
 def temp_read_val_cb(value):
-    print('Temperature: ' + (value[0]))
+    print('Temperature: %.2f C' % parse_temperature(value))
 
 def led_read_val_cb(value):
     if (int(value[0])) == 0 :
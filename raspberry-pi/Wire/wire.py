@@ -0,0 +1,137 @@
+"""Host side of the relay's wired bridge (nrf52840-dk/src/wire.h).
+
+Frames are COBS encoded and end with a 0x00 byte. Decoded, a frame is a
+batch of records { type u8 | len u8 | data } followed by a CRC-16/CCITT
+(seed 0xffff, as Zephyr's crc16_ccitt) over the records, little endian.
+"""
+
+import struct
+
+REC_SHADOW = 0x01
+REC_COMMAND = 0x02
+REC_ACK = 0x03
+REC_PING = 0x04
+REC_PONG = 0x05
+
+NODE_ALL = 0xff
+
+CHR_TEMP = 0
+CHR_LED = 1
+
+CRC_SEED = 0xffff
+
+
+def crc16_ccitt(data, seed=CRC_SEED):
+    crc = seed
+    for b in data:
+        e = (crc ^ b) & 0xff
+        f = (e ^ (e << 4)) & 0xff
+        crc = ((crc >> 8) ^ (f << 8) ^ (f << 3) ^ (f >> 4)) & 0xffff
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_pos = 0
+    code = 1
+    for b in data:
+        if b:
+            out.append(b)
+            code += 1
+        if not b or code == 0xff:
+            out[code_pos] = code
+            code_pos = len(out)
+            out.append(0)
+            code = 1
+    out[code_pos] = code
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            raise ValueError('bad COBS block')
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code < 0xff and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(records):
+    """records: iterable of (type, data) -> bytes ready for the wire."""
+    body = b''.join(struct.pack('<BB', t, len(d)) + bytes(d) for t, d in records)
+    body += struct.pack('<H', crc16_ccitt(body))
+    return cobs_encode(body) + b'\x00'
+
+
+def decode_frame(frame):
+    """frame: bytes between delimiters -> list of (type, data)."""
+    body = cobs_decode(frame)
+    if len(body) < 2 or crc16_ccitt(body[:-2]) != struct.unpack('<H', body[-2:])[0]:
+        raise ValueError('bad CRC')
+    body = body[:-2]
+    records = []
+    pos = 0
+    while pos < len(body):
+        if len(body) - pos < 2 or len(body) - pos - 2 < body[pos + 1]:
+            raise ValueError('bad record')
+        t, n = body[pos], body[pos + 1]
+        records.append((t, body[pos + 2:pos + 2 + n]))
+        pos += 2 + n
+    return records
+
+
+def parse_shadow(data):
+    """Relay frame record -> (node, chr, seq, origin, hops, value)."""
+    node, chr_, seq, origin, hops = struct.unpack('<BBHBB', data[:6])
+    return node, chr_, seq, origin, hops, data[6:]
+
+
+def temperature(value):
+    """Temperature value -> degrees C: sint16 LE in 0.01 degree units, or
+    a legacy single byte of whole degrees."""
+    if len(value) == 1:
+        return float(struct.unpack('<b', value)[0])
+    return struct.unpack('<h', value[:2])[0] / 100
+
+
+def command(tag, node, chr_, value):
+    return (REC_COMMAND, struct.pack('<BBB', tag, node, chr_) + bytes(value))
+
+
+class Link:
+    """Framed records over a serial port (pyserial) or pty."""
+
+    def __init__(self, port, baudrate=1000000, timeout=0.1):
+        import serial
+        self.ser = serial.Serial(port, baudrate, timeout=timeout)
+        self.rx = bytearray()
+        self.errors = 0
+
+    def send(self, records):
+        self.ser.write(encode_frame(records))
+
+    def recv(self):
+        """Return the records of every complete frame received so far."""
+        self.rx += self.ser.read(max(1, self.ser.in_waiting))
+        records = []
+        while True:
+            end = self.rx.find(0)
+            if end < 0:
+                return records
+            frame = bytes(self.rx[:end])
+            del self.rx[:end + 1]
+            if not frame:
+                continue
+            try:
+                records += decode_frame(frame)
+            except ValueError:
+                self.errors += 1
+
+    def close(self):
+        self.ser.close()
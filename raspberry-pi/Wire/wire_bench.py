@@ -0,0 +1,76 @@
+"""Throughput benchmark for the relay's wired bridge.
+
+Keeps a window of PING records in flight and reports echoed records and
+bytes per second, round-trip times, and the shadow updates the relay
+pushed meanwhile. Works with /dev/ttyACM0 (USB CDC ACM), a UART, or the
+pty a native_sim build prints for its second UART.
+
+    python3 wire_bench.py /dev/ttyACM0 --seconds 10 --size 32 --window 16
+"""
+
+import argparse
+import struct
+import time
+
+import wire
+
+
+def percentile(values, pct):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * pct / 100))]
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('port')
+    ap.add_argument('--baud', type=int, default=1000000)
+    ap.add_argument('--seconds', type=float, default=10)
+    ap.add_argument('--size', type=int, default=32, help='PING payload bytes (>= 4)')
+    ap.add_argument('--window', type=int, default=16, help='PINGs in flight')
+    ap.add_argument('--batch', type=int, default=4, help='PINGs per frame')
+    args = ap.parse_args()
+
+    link = wire.Link(args.port, args.baud)
+    sent = {}
+    rtts = []
+    seq = 0
+    pongs = 0
+    shadows = 0
+    pad = bytes(max(0, args.size - 4))
+
+    start = time.monotonic()
+    while time.monotonic() - start < args.seconds:
+        batch = []
+        while len(sent) + len(batch) < args.window and len(batch) < args.batch:
+            sent[seq] = time.monotonic()
+            batch.append((wire.REC_PING, struct.pack('<I', seq) + pad))
+            seq = (seq + 1) & 0xffffffff
+        if batch:
+            link.send(batch)
+
+        for t, data in link.recv():
+            if t == wire.REC_PONG and len(data) >= 4:
+                t0 = sent.pop(struct.unpack('<I', data[:4])[0], None)
+                if t0 is not None:
+                    rtts.append(time.monotonic() - t0)
+                    pongs += 1
+            elif t == wire.REC_SHADOW:
+                shadows += 1
+    elapsed = time.monotonic() - start
+    link.close()
+
+    # Both directions carry the payload plus a 2-byte record header.
+    rec_bytes = (args.size + 2) * pongs * 2
+    print('pongs      %d (%.0f/s), %d lost in flight' % (pongs, pongs / elapsed, len(sent)))
+    print('payload    %.1f kB/s both ways' % (rec_bytes / elapsed / 1000))
+    print('rtt        p50 %.2f ms  p99 %.2f ms  max %.2f ms' % (
+        percentile(rtts, 50) * 1000, percentile(rtts, 99) * 1000,
+        max(rtts, default=0) * 1000))
+    print('shadows    %d (%.0f/s)' % (shadows, shadows / elapsed))
+    print('bad frames %d' % link.errors)
+
+
+if __name__ == '__main__':
+    main()